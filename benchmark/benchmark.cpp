@@ -0,0 +1,302 @@
+#include <huffer.hpp>
+#include <format.hpp>
+#include <histogram.hpp>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string.h>
+
+/*
+Throughput benchmarks over generated inputs. Each result is one JSON
+object per line on standard output, so runs from two releases can be
+diffed or loaded into a spreadsheet:
+{"benchmark": NAME, "corpus": CORPUS, "input_bytes": N, "output_bytes": N,
+ "seconds": BEST TIME, "mb_per_s": N, "ratio": OUTPUT / INPUT, "ops_per_s": N}
+mb_per_s is over the uncompressed size in both directions. Times are the
+best of --reps runs. Progress goes to standard error.
+*/
+
+constexpr std::uint64_t BENCH_SEED = 0x5eed;
+constexpr std::size_t MIB = 1 << 20;
+constexpr std::size_t DEFAULT_CORPUS_MIB = 32;
+constexpr std::size_t DEFAULT_LARGE_MIB = 2048; // the multi-GB file
+constexpr std::size_t QUICK_CORPUS_MIB = 4;
+constexpr std::size_t QUICK_LARGE_MIB = 64;
+constexpr std::size_t TINY_FILE_COUNT = 1000;
+constexpr unsigned DEFAULT_REPS = 3;
+constexpr unsigned MICRO_OPS = 10000; // tree builds or headers per timed run
+
+struct BenchSettings {
+    std::size_t corpusBytes = DEFAULT_CORPUS_MIB * MIB;
+    std::size_t largeBytes = DEFAULT_LARGE_MIB * MIB;
+    unsigned reps = DEFAULT_REPS;
+    std::string dir = (std::filesystem::temp_directory_path() / "csc_bench").string();
+    CscOptions options;
+};
+
+struct BenchResult {
+    std::string benchmark;
+    std::string corpus;
+    std::uint64_t inputBytes = 0;
+    std::uint64_t outputBytes = 0;
+    std::uint64_t rawBytes = 0; // uncompressed bytes handled, for mb_per_s
+    double seconds = 0;
+    std::uint64_t ops = 0; // for benchmarks measured per operation rather than per byte
+};
+
+// Best wall time of reps runs of f, in seconds
+static double bestTime(const unsigned reps, const std::function<void()>& f) {
+    double best = 0;
+    for (unsigned i = 0; i < reps; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (i == 0 || elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+static void printResult(const BenchResult& r) {
+    std::ostringstream line;
+    line << "{\"benchmark\": \"" << r.benchmark << "\", \"corpus\": \"" << r.corpus
+         << "\", \"input_bytes\": " << r.inputBytes << ", \"output_bytes\": " << r.outputBytes
+         << ", \"seconds\": " << r.seconds
+         << ", \"mb_per_s\": " << (r.seconds > 0 ? r.rawBytes / 1e6 / r.seconds : 0)
+         << ", \"ratio\": " << (r.inputBytes > 0 ? (double) r.outputBytes / r.inputBytes : 0)
+         << ", \"ops_per_s\": " << (r.seconds > 0 ? r.ops / r.seconds : 0) << "}\n";
+    std::cout << line.str() << std::flush;
+}
+
+/* Generated inputs, each deterministic for a given seed and size:
+   uniform: independent random bytes (incompressible)
+   text: words from a Zipf-distributed vocabulary, like prose or source code
+   skewed: geometrically distributed bytes, mostly one value (long runs of short codes) */
+class CorpusGenerator {
+    public:
+        CorpusGenerator(const std::string& kind, const std::uint64_t seed) :
+            kind(kind), rng(seed) {
+            if (kind == "text") {
+                std::uniform_int_distribution<int> wordLen(1, 10);
+                std::uniform_int_distribution<int> letter('a', 'z');
+                for (int i = 0; i < 4096; i++) {
+                    std::string word;
+                    for (int j = wordLen(rng); j > 0; j--)
+                        word += (char) letter(rng);
+                    vocabulary.push_back(word);
+                    zipfWeights.push_back(1.0 / (i + 1));
+                }
+            }
+        }
+
+        // Fills out with the next n bytes of the corpus
+        void fill(std::byte* out, const std::size_t n) {
+            if (kind == "uniform") {
+                for (std::size_t i = 0; i < n; i++)
+                    out[i] = (std::byte) (rng() & 0xFF);
+            } else if (kind == "skewed") {
+                std::geometric_distribution<int> dist(0.6);
+                for (std::size_t i = 0; i < n; i++)
+                    out[i] = (std::byte) std::min(dist(rng), 255);
+            } else {
+                std::discrete_distribution<std::size_t> pick(zipfWeights.begin(), zipfWeights.end());
+                std::uniform_int_distribution<int> lineBreak(0, 11);
+                for (std::size_t i = 0; i < n;) {
+                    if (pending.empty())
+                        pending = vocabulary[pick(rng)] + (lineBreak(rng) == 0 ? '\n' : ' ');
+                    std::size_t take = std::min(pending.size(), n - i);
+                    memcpy(out + i, pending.data(), take);
+                    pending.erase(0, take);
+                    i += take;
+                }
+            }
+        }
+
+    private:
+        std::string kind;
+        std::mt19937_64 rng;
+        std::vector<std::string> vocabulary;
+        std::vector<double> zipfWeights;
+        std::string pending;
+};
+
+static std::vector<std::byte> generate(const std::string& kind, const std::size_t n) {
+    std::vector<std::byte> data(n);
+    CorpusGenerator(kind, BENCH_SEED).fill(data.data(), n);
+    return data;
+}
+
+static void writeBytes(const std::string& path, const std::byte* data, const std::size_t n) {
+    std::ofstream wf(path, std::ios::out | std::ios::binary);
+    wf.write(reinterpret_cast<const char*>(data), n);
+    if (!wf)
+        throw std::invalid_argument("Can't write " + path);
+}
+
+// Writes n bytes of a corpus to path in IO_BUFFER_SIZE pieces, for files too big to hold
+static void writeCorpusFile(const std::string& kind, const std::string& path, const std::size_t n) {
+    CorpusGenerator gen(kind, BENCH_SEED);
+    std::vector<std::byte> buffer(IO_BUFFER_SIZE);
+    std::ofstream wf(path, std::ios::out | std::ios::binary);
+    for (std::size_t done = 0; done < n;) {
+        std::size_t chunk = std::min(buffer.size(), n - done);
+        gen.fill(buffer.data(), chunk);
+        wf.write(reinterpret_cast<const char*>(buffer.data()), chunk);
+        done += chunk;
+    }
+    if (!wf)
+        throw std::invalid_argument("Can't write " + path);
+}
+
+// Compresses and decompresses each file, reporting both directions over their total size
+static void benchFiles(
+        const std::string& corpus, const std::vector<std::string>& files,
+        const unsigned reps, const CscOptions& options) {
+    BenchResult comp{"writeCompFile", corpus};
+    BenchResult decomp{"writeDecompFile", corpus};
+    for (const std::string& f : files)
+        comp.inputBytes += std::filesystem::file_size(f);
+    comp.rawBytes = comp.inputBytes;
+    comp.seconds = bestTime(reps, [&]() {
+        for (const std::string& f : files)
+            writeCompFile(f, f + COMPRESSION_EXT, false, false, options);
+    });
+    for (const std::string& f : files)
+        comp.outputBytes += std::filesystem::file_size(f + COMPRESSION_EXT);
+    decomp.inputBytes = comp.outputBytes;
+    decomp.outputBytes = comp.inputBytes;
+    decomp.rawBytes = comp.inputBytes;
+    decomp.seconds = bestTime(reps, [&]() {
+        for (const std::string& f : files)
+            writeDecompFile(f + COMPRESSION_EXT, f + ".out", false, false, options);
+    });
+    for (const std::string& f : files) {
+        if (std::filesystem::file_size(f + ".out") != std::filesystem::file_size(f))
+            throw std::runtime_error("Round trip changed the size of " + f);
+        std::filesystem::remove(f + COMPRESSION_EXT);
+        std::filesystem::remove(f + ".out");
+    }
+    printResult(comp);
+    printResult(decomp);
+}
+
+// Histogram, tree build and header generation on data already in memory
+static void benchStages(
+        const std::string& corpus, const std::vector<std::byte>& data,
+        const unsigned reps, const CscOptions& options) {
+    std::vector<std::uint64_t> freqs;
+    BenchResult hist{"histogram", corpus, data.size(), 0, data.size()};
+    hist.seconds = bestTime(reps, [&]() { freqs = byteHistogram(data.data(), data.size()); });
+    hist.ops = 1;
+    printResult(hist);
+
+    std::vector<std::uint8_t> lengths(freqs.size(), 0);
+    HuffTree tree;
+    BenchResult build{"treeBuild", corpus, 0, 0};
+    build.ops = MICRO_OPS;
+    build.seconds = bestTime(reps, [&]() {
+        for (unsigned i = 0; i < MICRO_OPS; i++) {
+            tree.build(freqs.data(), freqs.size());
+            tree.codeLengths(lengths.data());
+        }
+    });
+    printResult(build);
+
+    lengths = huffmanCodeLengths(freqs, options.maxCodeLength);
+    BenchResult header{"headerGen", corpus, 0, 0};
+    header.ops = MICRO_OPS;
+    header.seconds = bestTime(reps, [&]() {
+        for (unsigned i = 0; i < MICRO_OPS; i++)
+            header.outputBytes = genHeaderBytesV2(".txt", data.size(), lengths).size();
+    });
+    printResult(header);
+}
+
+static void printUsage() {
+    std::cerr << "Usage: csc_bench [--quick] [--reps N] [--size MIB] [--large MIB] "
+                 "[--dir PATH] [-j N] [-b KIB] [-L LEVEL]\n"
+                 "  --quick: small inputs for a smoke run\n"
+                 "  --size: size of each generated corpus (default "
+              << DEFAULT_CORPUS_MIB << ")\n"
+                 "  --large: size of the large file, 0 to skip it (default "
+              << DEFAULT_LARGE_MIB << ")\n";
+}
+
+static bool parseArgs(const int argc, char* argv[], BenchSettings& settings) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--quick") {
+            settings.corpusBytes = QUICK_CORPUS_MIB * MIB;
+            settings.largeBytes = QUICK_LARGE_MIB * MIB;
+            settings.reps = 1;
+        } else if (arg == "--reps" && hasValue) {
+            settings.reps = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--size" && hasValue) {
+            settings.corpusBytes = strtoull(argv[++i], nullptr, 10) * MIB;
+        } else if (arg == "--large" && hasValue) {
+            settings.largeBytes = strtoull(argv[++i], nullptr, 10) * MIB;
+        } else if (arg == "--dir" && hasValue) {
+            settings.dir = argv[++i];
+        } else if (arg == "-j" && hasValue) {
+            settings.options.threads = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-b" && hasValue) {
+            settings.options.blockSize = strtoull(argv[++i], nullptr, 10) * 1024;
+        } else if (arg == "-L" && hasValue) {
+            settings.options.level = std::clamp((unsigned) atoi(argv[++i]), MIN_LEVEL, MAX_LEVEL);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchSettings settings;
+    if (!parseArgs(argc, argv, settings)) {
+        printUsage();
+        return 2;
+    }
+    std::filesystem::create_directories(settings.dir);
+    try {
+        for (const std::string corpus : {"uniform", "text", "skewed"}) {
+            std::cerr << "Benchmarking " << corpus << " ...\n";
+            std::vector<std::byte> data = generate(corpus, settings.corpusBytes);
+            benchStages(corpus, data, settings.reps, settings.options);
+            std::string path = (std::filesystem::path(settings.dir) / corpus).string();
+            writeBytes(path, data.data(), data.size());
+            benchFiles(corpus, {path}, settings.reps, settings.options);
+            std::filesystem::remove(path);
+        }
+
+        std::cerr << "Benchmarking tiny files ...\n";
+        std::vector<std::string> tinyFiles = std::vector<std::string>();
+        CorpusGenerator text("text", BENCH_SEED);
+        std::mt19937_64 rng(BENCH_SEED);
+        std::uniform_int_distribution<std::size_t> tinySize(1, 4096);
+        std::vector<std::byte> buffer(4096);
+        for (std::size_t i = 0; i < TINY_FILE_COUNT; i++) {
+            std::size_t n = tinySize(rng);
+            text.fill(buffer.data(), n);
+            tinyFiles.push_back(
+                (std::filesystem::path(settings.dir) / ("tiny" + std::to_string(i))).string());
+            writeBytes(tinyFiles.back(), buffer.data(), n);
+        }
+        benchFiles("tiny", tinyFiles, settings.reps, settings.options);
+        for (const std::string& f : tinyFiles)
+            std::filesystem::remove(f);
+
+        if (settings.largeBytes > 0) {
+            std::cerr << "Benchmarking a " << settings.largeBytes / MIB << " MiB file ...\n";
+            std::string path = (std::filesystem::path(settings.dir) / "large").string();
+            writeCorpusFile("text", path, settings.largeBytes);
+            benchFiles("large", {path}, 1, settings.options);
+            std::filesystem::remove(path);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
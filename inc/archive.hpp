@@ -0,0 +1,55 @@
+#ifndef ARCHIVE
+#define ARCHIVE
+#include <huffer.hpp>
+#include <format.hpp>
+
+/*
+Archive Manifest Notation (follows a version 2 header whose FLAGS are
+CSC_FLAG_BLOCKS | CSC_FLAG_ARCHIVE and whose NUM_EXT_CHARS is 0): ITEM [BYTE LENGTH OF ITEM]
+#####
+NUM_MEMBERS [VARINT]
+(  PATH_LENGTH [VARINT]
+   PATH [PATH_LENGTH]   relative to the archived directory, '/'-separated
+   SIZE [VARINT]
+   MTIME [8]   seconds since the Unix epoch, little-endian two's complement  )[NUM_MEMBERS]
+The payload is every member's contents back to back in manifest order, as
+blocks (see blocks.hpp). Members are ordered by extension and then path, so
+small files of the same type share blocks and code tables. A member's
+offset in the original data is the sum of the sizes before it.
+*/
+
+// One file stored in an archive
+struct ArchiveMember {
+    std::string path;
+    std::uint64_t offset;
+    std::uint64_t size;
+    std::int64_t mtime;
+};
+
+/* Reads the manifest that follows an archive header, checking that the
+members exactly cover the original data and that no path leaves the
+extraction directory. */
+std::vector<ArchiveMember> readManifest(std::istream& rf, const CscHeader& header);
+
+// Compresses every file under dirPath, recursively, into one archive
+void writeArchive(
+    const std::string& dirPath,
+    const std::string& archiveFile,
+    const bool verbose,
+    const CscOptions& options);
+
+std::vector<ArchiveMember> listArchive(const std::string& archiveFile);
+
+/* Extracts the members named in options.members (all of them if it's empty)
+into outputDir, decoding each block once. Members whose output already
+exists are skipped; returns the number of members skipped. */
+std::size_t extractArchive(
+    const std::string& archiveFile,
+    const std::string& outputDir,
+    const bool verbose,
+    const CscOptions& options);
+
+// Decodes and checks every block of an archive without writing any members
+void testArchive(const std::string& archiveFile, const CscOptions& options);
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef BITSTREAM
+#define BITSTREAM
+#include <cstdint>
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+constexpr std::size_t BIT_READER_CHUNK_SIZE = 1 << 16; // == 64 KiB
+constexpr std::size_t BIT_WRITER_CHUNK_SIZE = 1 << 20; // == 1 MiB
+
+// Reads 8 bytes as a big-endian integer (compilers turn this into load + bswap)
+inline std::uint64_t loadBigEndian64(const std::byte* p) {
+    std::uint64_t v = 0;
+    for (int i = 0; i < 8; i++)
+        v = (v << 8) | (std::uint64_t) p[i];
+    return v;
+}
+
+inline void storeBigEndian64(std::byte* p, const std::uint64_t v) {
+    for (int i = 0; i < 8; i++)
+        p[i] = (std::byte) (v >> (56 - 8 * i));
+}
+
+/* MSB-first bit reader over a 64-bit buffer.
+After refill() at least 56 bits can be peeked. Reading past the end of
+the input yields zero bits, which overrun() reports once they are consumed. */
+class BitReader {
+    public:
+        explicit BitReader(std::istream& source);
+
+        BitReader(const std::byte* data, const std::size_t length);
+
+        inline void refill() {
+            if (end - pos >= 8) {
+                bits |= loadBigEndian64(pos) >> count;
+                pos += (63 - count) >> 3;
+                count |= 56;
+            } else {
+                refillSlow();
+            }
+        }
+
+        // n must be in [1, 56]
+        inline std::uint64_t peek(const unsigned n) const {
+            return bits >> (64 - n);
+        }
+
+        inline void consume(const unsigned n) {
+            bits <<= n;
+            count -= n;
+        }
+
+        inline bool overrun() const {
+            return count < paddingBits;
+        }
+
+    private:
+        void refillSlow();
+
+        std::istream* source;
+        std::vector<std::byte> buffer;
+        const std::byte* pos;
+        const std::byte* end;
+        std::uint64_t bits = 0;
+        unsigned count = 0;
+        unsigned paddingBits = 0;
+};
+
+/* MSB-first bit writer with a 64-bit accumulator.
+Bytes go to a large buffer that is either drained into an output stream
+or, in vector mode, is the target vector itself. */
+class BitWriter {
+    public:
+        explicit BitWriter(std::ostream& sink);
+
+        // appends to the end of target
+        explicit BitWriter(std::vector<std::byte>& target);
+
+        // len must be in [1, 56]; codes up to 64 bits go through writeLong
+        inline void write(const std::uint64_t code, const unsigned len) {
+            if (count + len > 63)
+                flush();
+            acc |= code << (64 - count - len);
+            count += len;
+        }
+
+        // write without the capacity check, for callers that flush() first
+        inline void put(const std::uint64_t code, const unsigned len) {
+            acc |= code << (64 - count - len);
+            count += len;
+        }
+
+        inline void writeLong(const std::uint64_t code, const unsigned len) {
+            if (len > 32) {
+                write(code >> 32, len - 32);
+                write(code & 0xFFFFFFFF, 32);
+            } else if (len > 0) {
+                write(code, len);
+            }
+        }
+
+        // moves whole bytes out of the accumulator, leaving at most 7 bits
+        inline void flush() {
+            storeBigEndian64(out, acc);
+            const unsigned n = count >> 3;
+            out += n;
+            acc <<= n * 8;
+            count &= 7;
+            if (out >= limit)
+                drain();
+        }
+
+        // pads the last byte with zero bits and writes everything out
+        void finish();
+
+        std::size_t bytesWritten() const;
+
+    private:
+        void drain();
+
+        std::ostream* sink;
+        std::vector<std::byte> ownBuffer;
+        std::vector<std::byte>* buffer;
+        std::size_t base;     // target size before this writer started
+        std::size_t drained = 0;
+        std::byte* out;
+        std::byte* limit;
+        std::uint64_t acc = 0;
+        unsigned count = 0;
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef BLOCKS
+#define BLOCKS
+#include <huffer.hpp>
+#include <format.hpp>
+#include <fileio.hpp>
+#include <split.hpp>
+#include <memory>
+
+/*
+Block Layout Notation (the payload of CSC_FLAG_BLOCKS files): ITEM [BYTE LENGTH OF ITEM]
+#####
+(  BLOCK_TYPE [1]
+   RAW_SIZE [VARINT]
+   BODY_SIZE [VARINT]
+   BODY [BODY_SIZE]
+   CHECKSUM [4]   CRC32C of the block's original bytes (only with CSC_FLAG_CHECKSUM)  )[NUM_BLOCKS]
+END_MARKER [1]   == BLOCK_END
+NUM_BLOCKS [VARINT]
+(  FRAME_SIZE [VARINT]   bytes from BLOCK_TYPE to the end of CHECKSUM (or BODY, without it)
+   RAW_SIZE [VARINT]  )[NUM_BLOCKS]
+INDEX_OFFSET [8]   file offset of NUM_BLOCKS, little-endian
+Every block has its own code table: a BLOCK_HUFFMAN body is
+PACKED_CODE_LENGTHS followed by the coded bits. A BLOCK_STORED body is the
+RAW_SIZE original bytes, used when coding wouldn't gain MIN_CODING_GAIN.
+A BLOCK_HUFFMAN4 body splits the block into INTERLEAVED_STREAMS parts of
+ceil(RAW_SIZE / INTERLEAVED_STREAMS) bytes (the last one shorter), each
+coded as its own bitstream with the shared table:
+   PACKED_CODE_LENGTHS [VARIES]
+   (  STREAM_SIZE [VARINT]  )[INTERLEAVED_STREAMS - 1]
+   STREAMS [VARIES]   the last stream runs to the end of BODY
+A BLOCK_CONTEXT body codes each byte with the table of its previous byte's
+cluster (see context.hpp):
+   NUM_CLUSTERS [1]
+   PACKED_CONTEXT_MAP [VARIES]   the cluster of each previous byte, packed like PACKED_CODE_LENGTHS
+   (  PACKED_CODE_LENGTHS [VARIES]  )[NUM_CLUSTERS]
+   the coded bits
+A BLOCK_LZ body codes the block as LZ77 literals and matches (see lz.hpp):
+   LITLEN_CODE_LENGTHS [VARIES]   packed like PACKED_CODE_LENGTHS, LZ_LITLEN_SYMBOLS long
+   DISTANCE_CODE_LENGTHS [VARIES]   packed likewise, LZ_DISTANCE_CODES long
+   the coded bits
+*/
+constexpr std::uint8_t BLOCK_HUFFMAN = 0;
+constexpr std::uint8_t BLOCK_STORED = 1;
+constexpr std::uint8_t BLOCK_HUFFMAN4 = 2;
+constexpr std::uint8_t BLOCK_CONTEXT = 3;
+constexpr std::uint8_t BLOCK_LZ = 4;
+
+// blocks smaller than this are coded as one stream even with options.interleave
+constexpr std::size_t MIN_INTERLEAVED_BLOCK_SIZE = 1024;
+// blocks smaller than this can't pay for several code tables, so skip the context model
+constexpr std::size_t MIN_CONTEXT_BLOCK_SIZE = 4096;
+// blocks smaller than this rarely repeat enough to pay for two code tables
+constexpr std::size_t MIN_LZ_BLOCK_SIZE = 1024;
+// the match finder holds positions in 32 bits, so larger blocks skip LZ
+constexpr std::size_t MAX_LZ_BLOCK_SIZE = UINT32_MAX;
+constexpr std::uint8_t BLOCK_END = 0xFF;
+
+constexpr std::size_t BLOCK_INDEX_OFFSET_SIZE = 8;
+
+// n_total_chars for writeBlocks when the input runs until end of stream
+constexpr std::uint64_t UNKNOWN_LENGTH = UINT64_MAX;
+
+// Where one block sits in the compressed file and in the original data
+struct BlockInfo {
+    std::uint64_t frameOffset;
+    std::uint64_t frameSize;
+    std::uint64_t rawOffset;
+    std::uint64_t rawSize;
+    bool checksummed; // the frame ends with CHECKSUM
+};
+
+// The header flag for blocks written with options
+inline std::uint8_t checksumFlag(const CscOptions& options) {
+    return options.checksums ? CSC_FLAG_CHECKSUM : 0;
+}
+
+// Compresses n bytes into a complete block frame, with a checksum if options.checksums
+std::vector<std::byte> compressBlock(
+    const std::byte* data, const std::size_t n, const CscOptions& options);
+
+/* Throws unless a block of type with body[0, bodyLen) could decode to
+rawSize bytes: a stored body is its bytes, a multi-symbol Huffman code takes
+at least a bit per byte, and no block is larger than MAX_BLOCK_SIZE. RAW_SIZE
+comes from the compressed data, so check it before allocating that much. */
+void checkBlockSize(
+    const std::uint8_t type, const std::byte* body, const std::size_t bodyLen,
+    const std::uint64_t rawSize);
+
+void decompressBlockBody(
+    const std::uint8_t type, const std::byte* body, const std::size_t bodyLen,
+    std::byte* out, const std::size_t rawSize);
+
+/* Compresses the next n_total_chars bytes of rf (or all of it, for
+UNKNOWN_LENGTH) as blocks on a thread pool and writes them to wf in order,
+followed by the block index. Each frame is flushed as soon as it's written.
+payloadOffset is where wf's first block lands in the output file.
+options are used as given, so callers apply levelOptions first.
+Returns the number of bytes compressed. */
+std::uint64_t writeBlocks(
+    std::istream& rf, std::ostream& wf, const std::uint64_t payloadOffset,
+    const std::uint64_t n_total_chars, const CscOptions& options);
+
+// As above, for input already in memory (such as a MappedFile), written with no I/O threads
+void writeBlocks(
+    const std::byte* data, std::ostream& wf, const std::uint64_t payloadOffset,
+    const std::uint64_t n_total_chars, const CscOptions& options);
+
+/* As above, for input in memory that findSplits has already cut into
+parts: each part is a block, coded with the counts found for it */
+void writeBlocks(
+    const std::byte* data, std::ostream& wf, const std::uint64_t payloadOffset,
+    const std::vector<SplitPart>& parts, const CscOptions& options);
+
+/* Decodes the blocks that follow a CSC_FLAG_BLOCKS header, reading rf in
+order so it needn't be seekable. Blocks are decoded on the thread pool as
+they're read and written in order by a writer thread (see threadsStreams).
+Returns the number of bytes written. */
+std::uint64_t readBlocks(
+    std::istream& rf, std::ostream& wf, const CscHeader& header, const CscOptions& options);
+
+// The batch's shared pool, or a new one held by ownPool
+ThreadPool& poolFor(const CscOptions& options, std::unique_ptr<ThreadPool>& ownPool);
+
+/* Whether reading and writing streams overlaps with coding on threads of
+their own (see pipeline.hpp): not when -j 1 asks for a single worker */
+inline bool threadsStreams(const CscOptions& options) {
+    return options.threads != 1;
+}
+
+/* Reads and checks the block index; payloadOffset is where the header ends.
+For CSC_FLAG_STREAM files the index decides the original length. */
+std::vector<BlockInfo> readBlockIndex(
+    PositionedFile& in, const CscHeader& header, const std::uint64_t payloadOffset);
+
+// Reads, decodes and checks one whole block, timing it in stats (which may be nullptr)
+std::vector<std::byte> decodeBlock(PositionedFile& in, const BlockInfo& info, CscStats* stats);
+
+/* Decodes the blocks overlapping original bytes [rangeStart, rangeEnd) on a
+thread pool, each one written straight to its place in outputFile. */
+void decodeBlocksParallel(
+    PositionedFile& in, const std::vector<BlockInfo>& blocks,
+    const std::string& outputFile, const std::uint64_t rangeStart,
+    const std::uint64_t rangeEnd, const CscOptions& options);
+
+/* Decodes every block on a thread pool, checking their checksums, and
+throws the first error found. Nothing is written. */
+void testBlocks(PositionedFile& in, const std::vector<BlockInfo>& blocks, const CscOptions& options);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef CHECKSUM
+#define CHECKSUM
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// bytes taken by a stored checksum, little-endian
+constexpr std::size_t CHECKSUM_SIZE = 4;
+
+/* CRC32C (Castagnoli) of data, continuing from crc (0 to start), so
+crc32c(crc32c(0, a), b) is the CRC of a followed by b. Uses the SSE4.2
+crc32 instruction on three interleaved streams where the CPU has it, and a
+slicing-by-8 table otherwise. */
+std::uint32_t crc32c(std::uint32_t crc, const std::byte* data, std::size_t n);
+
+// crc32c with the slicing-by-8 table only, whatever the CPU has
+std::uint32_t crc32cSoftware(std::uint32_t crc, const std::byte* data, std::size_t n);
+
+void putChecksum(std::vector<std::byte>& out, const std::uint32_t crc);
+
+std::uint32_t loadChecksum(const std::byte* p);
+
+// Throws std::runtime_error unless actual == expected
+void verifyChecksum(const std::uint32_t actual, const std::uint32_t expected);
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef CODEC
+#define CODEC
+#include <huffer.hpp>
+#include <format.hpp>
+#include <memory>
+#include <optional>
+#if __cplusplus >= 202002L
+    #include <span>
+#endif
+
+/* How a single-stream payload gets coded (see chooseSingleStreamCode):
+stored as is, or after header with dictionaryTable, or with a table of its
+own built from lengths. estimated marks a coded size that's only a guess,
+from sampled counts or none at all, for encodeSingleStream to check. */
+struct SingleStreamCode {
+    bool stored = false;
+    bool estimated = false;
+    std::vector<std::byte> header;
+    std::vector<std::uint8_t> lengths;
+    const EncodeTable* dictionaryTable = nullptr;
+};
+
+/* Picks the header and table for data[0, n) coded as one stream, or
+storing, for both files and Encoder. A named dictionary table is used as
+given; otherwise the file's own table (or lastLengths, where keepTable
+allows) and the best dictionary table are weighed against each other and
+against storing. ext and checksum go in the header. counted holds data's
+byte counts where the caller already has them, or is nullptr to count here. */
+SingleStreamCode chooseSingleStreamCode(
+    const std::byte* data, const std::size_t n, const std::string& ext,
+    const std::optional<std::uint32_t> checksum, const CscOptions& options,
+    const std::vector<std::uint64_t>* counted = nullptr,
+    const std::vector<std::uint8_t>& lastLengths = {});
+
+/* Appends code.header and data[0, n) coded with table to out. Returns
+false, taking them off again, if an estimated code turned out not to gain
+enough, so the caller should store the data instead. */
+bool encodeSingleStream(
+    const std::byte* data, const std::size_t n, const SingleStreamCode& code,
+    const EncodeTable& table, std::vector<std::byte>& out, CscStats* stats = nullptr);
+
+/* In-memory compression with no files and no console output.
+The output is a complete compressed file, so it can also be saved and
+decompressed by csc -d. Inputs larger than options.blockSize are split
+into blocks coded in parallel, as for files.
+An Encoder keeps its last code table and thread pool
+between calls, so reuse one per thread for many small payloads. At fast
+levels it keeps coding with its last table while keepTable allows. */
+class Encoder {
+    public:
+        explicit Encoder(const CscOptions& options = CscOptions());
+
+        ~Encoder();
+
+        // Replaces out with the compressed form of data[0, n)
+        void compress(const std::byte* data, const std::size_t n, std::vector<std::byte>& out);
+
+#if __cplusplus >= 202002L
+        void compress(std::span<const std::byte> data, std::vector<std::byte>& out) {
+            compress(data.data(), data.size(), out);
+        }
+#endif
+
+    private:
+        ThreadPool& blockPool();
+
+        CscOptions options;
+        std::vector<std::uint8_t> tableLengths; // lengths table was built for
+        EncodeTable table;
+        std::unique_ptr<ThreadPool> ownPool;
+};
+
+/* Decompresses whole files held in memory (anything but archives).
+A Decoder keeps the last single-stream decoding table and reuses it when
+the next payload has the same code lengths. */
+class Decoder {
+    public:
+        explicit Decoder(const CscOptions& options = CscOptions());
+
+        ~Decoder();
+
+        // Replaces out with the decompressed form of data[0, n)
+        void decompress(const std::byte* data, const std::size_t n, std::vector<std::byte>& out);
+
+#if __cplusplus >= 202002L
+        void decompress(std::span<const std::byte> data, std::vector<std::byte>& out) {
+            decompress(data.data(), data.size(), out);
+        }
+#endif
+
+    private:
+        ThreadPool& blockPool();
+
+        CscOptions options;
+        std::vector<HuffCode> tableCodes; // codes table was built from
+        std::unique_ptr<DecodeTable> table;
+        std::unique_ptr<ThreadPool> ownPool;
+};
+
+// One-off versions of Encoder::compress and Decoder::decompress
+std::vector<std::byte> compressBuffer(
+    const std::byte* data, const std::size_t n, const CscOptions& options = CscOptions());
+
+std::vector<std::byte> decompressBuffer(
+    const std::byte* data, const std::size_t n, const CscOptions& options = CscOptions());
+
+#if __cplusplus >= 202002L
+inline std::vector<std::byte> compressBuffer(
+        std::span<const std::byte> data, const CscOptions& options = CscOptions()) {
+    return compressBuffer(data.data(), data.size(), options);
+}
+
+inline std::vector<std::byte> decompressBuffer(
+        std::span<const std::byte> data, const CscOptions& options = CscOptions()) {
+    return decompressBuffer(data.data(), data.size(), options);
+}
+#endif
+
+#endif
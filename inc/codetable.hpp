@@ -0,0 +1,130 @@
+#ifndef CODETABLE
+#define CODETABLE
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <stdexcept>
+#include <bitstream.hpp>
+
+constexpr unsigned DECODE_PRIMARY_BITS = 11;
+constexpr unsigned DECODE_SUBTABLE_BITS = 8;
+constexpr unsigned MAX_DECODABLE_CODE_LENGTH = 64;
+
+// A prefix code for one symbol, right-aligned in bits
+struct HuffCode {
+    std::uint64_t bits;
+    std::uint8_t length;
+    std::uint16_t symbol;
+};
+
+/* A lookup table entry. Symbol entries may hold two symbols
+(first in the low 16 bits of value) when both codes fit in the primary
+table index; link entries point at a sub-table for longer codes. */
+struct DecodeEntry {
+    std::uint32_t value;
+    std::uint8_t length;      // bits used by all symbols, or sub-table width
+    std::uint8_t firstLength; // bits used by the first symbol
+    std::uint8_t count;       // number of symbols, DECODE_LINK or DECODE_INVALID
+};
+
+constexpr std::uint8_t DECODE_LINK = 0;
+constexpr std::uint8_t DECODE_INVALID = 0xFF;
+
+/* Multi-level Huffman decoding table: a primary table indexed by the next
+primaryBits bits, with chained sub-tables of up to DECODE_SUBTABLE_BITS
+bits each for codes that don't fit in it. */
+class DecodeTable {
+    public:
+        explicit DecodeTable(std::vector<HuffCode> codes);
+
+        unsigned primaryBits;
+        unsigned maxLength;
+        std::vector<DecodeEntry> entries;
+        // set when every code fits the primary table and none is missing
+        bool primaryOnly;
+        // set when the only code is empty (single-symbol input)
+        bool singleSymbol;
+        std::uint16_t onlySymbol;
+
+    private:
+        void fill(std::size_t offset, unsigned width, unsigned consumed,
+                  const HuffCode* first, const HuffCode* last);
+
+        void pairPrimaryEntries();
+};
+
+/* Optimal code lengths (indexed by symbol) with no code longer than
+maxLength bits, found with the package-merge algorithm. */
+std::vector<std::uint8_t> limitedCodeLengths(
+    const std::vector<std::uint64_t>& freqs, const unsigned maxLength);
+
+/* A cheap stand-in for limitedCodeLengths, given the unlimited Huffman
+lengths for freqs: codes longer than maxLength bits are cut to maxLength,
+then the shorter codes that free the most space per bit they add are
+lengthened until the lengths form a prefix code again, and any space left over goes to the most
+frequent codes. Slightly longer on average than the optimal lengths. */
+std::vector<std::uint8_t> clampedCodeLengths(
+    const std::vector<std::uint64_t>& freqs, std::vector<std::uint8_t> lengths,
+    const unsigned maxLength);
+
+// Total bits needed to code symbols with these counts and code lengths
+std::uint64_t codedBits(
+    const std::vector<std::uint64_t>& freqs, const std::vector<std::uint8_t>& lengths);
+
+/* Assigns canonical codes from code lengths (indexed by symbol): shorter
+codes first, ties broken by symbol. Symbols with length 0 get no code. */
+std::vector<HuffCode> canonicalCodes(const std::vector<std::uint8_t>& lengths);
+
+/* Flat encoding table: codes[symbol] holds the code for each symbol
+(length 0 if unused) so encoding is an array lookup and a shift. */
+class EncodeTable {
+    public:
+        explicit EncodeTable(const std::size_t alphabetSize = 256);
+
+        EncodeTable(const std::vector<HuffCode>& codes, const std::size_t alphabetSize = 256);
+
+        void set(const HuffCode& code);
+
+        std::vector<HuffCode> codes;
+        unsigned maxLength;
+};
+
+// Encodes n bytes from in into bw
+void encodeBytes(
+    const EncodeTable& table, const std::byte* in, const std::size_t n, BitWriter& bw);
+
+/* Decodes one symbol, ignoring any second symbol paired with it, for
+callers whose next symbol doesn't come from the same table. */
+inline std::uint16_t decodeSymbol(const DecodeTable& table, BitReader& br) {
+    if (table.singleSymbol)
+        return table.onlySymbol;
+    br.refill();
+    DecodeEntry e = table.entries[br.peek(table.primaryBits)];
+    unsigned width = table.primaryBits;
+    while (e.count == DECODE_LINK) {
+        br.consume(width);
+        br.refill();
+        width = e.length;
+        e = table.entries[e.value + br.peek(width)];
+    }
+    if (e.count == DECODE_INVALID)
+        throw std::runtime_error("Invalid Huffman code in compressed data");
+    br.consume(e.firstLength);
+    return (std::uint16_t) e.value;
+}
+
+// Decodes n byte symbols from br into out
+void decodeBytes(
+    const DecodeTable& table, BitReader& br, std::byte* out, const std::size_t n);
+
+constexpr std::size_t INTERLEAVED_STREAMS = 4;
+
+/* Decodes INTERLEAVED_STREAMS bitstreams coded with the same table, stream s
+being streamSizes[s] bytes at streams[s] and filling sizes[s] bytes at
+outs[s]. The last part may be shorter than the others. Each step takes a
+symbol from every stream, so their table lookups don't wait on each other. */
+void decodeInterleaved(
+    const DecodeTable& table, const std::byte* const* streams,
+    const std::size_t* streamSizes, std::byte* const* outs, const std::size_t* sizes);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef CONTEXT
+#define CONTEXT
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <codetable.hpp>
+
+constexpr unsigned MIN_CONTEXT_CLUSTERS = 2;
+constexpr unsigned MAX_CONTEXT_CLUSTERS = 16;
+constexpr unsigned DEFAULT_CONTEXT_CLUSTERS = 8;
+
+/* An order-1 model: the byte before each symbol picks which of a few
+clustered frequency tables it is coded with. Previous bytes whose next-byte
+distributions look alike share a cluster, so only numClusters code tables
+are stored. The first byte of a block has previous byte 0. */
+struct ContextModel {
+    unsigned numClusters = 0;
+    std::uint8_t clusterOf[256] = {};
+    std::vector<std::vector<std::uint64_t>> freqs; // symbol counts per cluster
+};
+
+/* Groups the 256 previous-byte contexts of data into at most maxClusters
+clusters with a few rounds of k-means, where a context's distance to a
+cluster is the bits needed to code its symbols with the cluster's
+frequencies. Empty clusters are dropped, so numClusters may be smaller. */
+ContextModel buildContextModel(const std::byte* data, const std::size_t n, const unsigned maxClusters);
+
+// Codes each byte of in with tables[clusterOf[previous byte]]
+void encodeBytesWithContext(
+    const EncodeTable* tables, const std::uint8_t* clusterOf,
+    const std::byte* in, const std::size_t n, BitWriter& bw);
+
+/* Decodes n bytes coded by encodeBytesWithContext. Each symbol needs its
+own lookup (see decodeSymbol), since the table for the next one depends on it. */
+void decodeBytesWithContext(
+    const DecodeTable* tables, const std::uint8_t* clusterOf,
+    BitReader& br, std::byte* out, const std::size_t n);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef DICTIONARY
+#define DICTIONARY
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <codetable.hpp>
+#include <format.hpp>
+
+/*
+Dictionary File Notation: ITEM [BYTE LENGTH OF ITEM]
+#####
+MAGIC [8]
+VERSION [1]
+NUM_TABLES [1]
+TABLES [VARIES]   (NUM_TABLES times PACKED_CODE_LENGTHS, see format.cpp)
+CHECKSUM [4]   (CRC32C of everything before it, little-endian)
+The CHECKSUM is also the dictionary's ID, written in the header of every
+file compressed with it (see CSC_FLAG_DICTIONARY).
+*/
+constexpr std::size_t CSC_DICTIONARY_MAGIC_SIZE = 8;
+constexpr unsigned char CSC_DICTIONARY_MAGIC[CSC_DICTIONARY_MAGIC_SIZE] = {
+    0x89, 'C', 'S', 'D', '\r', '\n', 0x1A, '\n'};
+constexpr std::uint8_t CSC_DICTIONARY_VERSION = 1;
+constexpr unsigned MIN_DICTIONARY_TABLES = 1;
+constexpr unsigned MAX_DICTIONARY_TABLES = 64;
+constexpr unsigned DEFAULT_DICTIONARY_TABLES = 8;
+// training reads at most this many bytes of each sample and this many samples
+constexpr std::size_t DICTIONARY_SAMPLE_BYTES = 1 << 16;
+constexpr std::size_t MAX_DICTIONARY_SAMPLES = 1 << 14;
+
+/* Huffman tables trained on sample files, which a small file can name in
+its header instead of storing its own code lengths. Every table has a code
+for all 256 byte values, so any data can be coded with any table. */
+struct CscDictionary {
+    std::uint32_t id = 0;
+    std::vector<std::vector<std::uint8_t>> lengths; // per table, indexed by byte value
+    std::vector<EncodeTable> encodeTables;           // built from lengths
+};
+
+/* Clusters the byte counts of the samples (one 256-entry table each) into
+at most numTables groups with k-means, where a sample's distance to a
+table is the bits needed to code it, and builds one table per group.
+Tables are added one at a time, each seeded with the sample the existing
+tables fit worst. */
+CscDictionary trainDictionary(
+    const std::vector<std::vector<std::uint64_t>>& samples,
+    const unsigned numTables, const unsigned maxCodeLength);
+
+/* trainDictionary over files, and the files in directories (recursively),
+taking the first DICTIONARY_SAMPLE_BYTES of each. With more than
+MAX_DICTIONARY_SAMPLES files, evenly spaced ones are used. */
+CscDictionary trainDictionary(
+    const std::vector<std::string>& paths,
+    const unsigned numTables, const unsigned maxCodeLength);
+
+std::vector<std::byte> dictionaryBytes(const CscDictionary& dictionary);
+
+// Throws std::runtime_error if data isn't an intact dictionary
+CscDictionary parseDictionary(const std::byte* data, const std::size_t n);
+
+void writeDictionary(const CscDictionary& dictionary, const std::string& path);
+
+CscDictionary readDictionary(const std::string& path);
+
+// One table's encoding table; throws std::invalid_argument if there's no such table
+const EncodeTable& dictionaryEncodeTable(const CscDictionary& dictionary, const unsigned table);
+
+// The table that codes symbols with these counts in the fewest bits, and those bits
+unsigned bestDictionaryTable(
+    const CscDictionary& dictionary, const std::vector<std::uint64_t>& freqs,
+    std::uint64_t& bits);
+
+/* Fills in header.codes from the dictionary table a CSC_FLAG_DICTIONARY
+header names; does nothing for other headers. Throws std::invalid_argument
+if dictionary is nullptr or isn't the one the file was compressed with. */
+void useDictionary(CscHeader& header, const CscDictionary* dictionary);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef FILEIO
+#define FILEIO
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#if defined(_WIN32)
+    #include <fstream>
+    #include <mutex>
+#endif
+
+/* A file read and written at explicit offsets, safe to share between threads
+(pread/pwrite on POSIX, a locked fstream elsewhere). */
+class PositionedFile {
+    public:
+        // writable files are created or truncated
+        PositionedFile(const std::string& path, const bool writable);
+
+        ~PositionedFile();
+
+        PositionedFile(const PositionedFile&) = delete;
+        PositionedFile& operator=(const PositionedFile&) = delete;
+
+        void readAt(const std::uint64_t offset, std::byte* data, const std::size_t n);
+
+        void writeAt(const std::uint64_t offset, const std::byte* data, const std::size_t n);
+
+        void resize(const std::uint64_t n);
+
+        std::uint64_t size();
+
+    private:
+        std::string path;
+#if defined(_WIN32)
+        std::fstream file;
+        std::mutex lock;
+#else
+        int fd;
+#endif
+};
+
+/* Read-only view of a whole file. Regular files are memory-mapped; for
+anything else (pipes, devices, or a failed mapping) mapped() is false and
+the caller falls back to streaming. */
+class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path);
+
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool mapped() const;
+
+        const std::byte* data() const;
+
+        std::uint64_t size() const;
+
+    private:
+        const std::byte* base = nullptr;
+        std::uint64_t length = 0;
+        bool isMapped = false;
+};
+
+#endif
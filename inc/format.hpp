@@ -0,0 +1,120 @@
+#ifndef FORMAT
+#define FORMAT
+#include <cstdint>
+#include <cstddef>
+#include <istream>
+#include <optional>
+#include <string>
+#include <vector>
+#include <codetable.hpp>
+
+/* Version 2 files start with CSC_MAGIC, which can't be mistaken for a
+version 1 header: read as a version 1 NUMBER_CHARS_TOTAL it would be ~7e17. */
+constexpr std::size_t CSC_MAGIC_SIZE = 8;
+constexpr unsigned char CSC_MAGIC[CSC_MAGIC_SIZE] = {
+    0x89, 'C', 'S', 'C', '\r', '\n', 0x1A, '\n'};
+constexpr std::uint8_t CSC_FORMAT_VERSION = 2;
+
+// FLAGS bits
+constexpr std::uint8_t CSC_FLAG_BLOCKS = 0x01;
+constexpr std::uint8_t CSC_FLAG_ARCHIVE = 0x02; // only with CSC_FLAG_BLOCKS (see archive.hpp)
+/* Only with CSC_FLAG_BLOCKS: the length wasn't known when the header was
+written, so NUMBER_CHARS_TOTAL is 0 and the blocks run up to END_MARKER. */
+constexpr std::uint8_t CSC_FLAG_STREAM = 0x04;
+/* Only without CSC_FLAG_BLOCKS: the data didn't compress, so there are no
+code lengths and the payload is the original bytes. */
+constexpr std::uint8_t CSC_FLAG_STORED = 0x08;
+/* The original data has CRC32C checksums (see checksum.hpp): one in the
+header for single-stream files, one after each block's body otherwise. */
+constexpr std::uint8_t CSC_FLAG_CHECKSUM = 0x10;
+/* Only without CSC_FLAG_BLOCKS and CSC_FLAG_STORED: the code lengths are
+a table of a shared dictionary (see dictionary.hpp), named by its ID. */
+constexpr std::uint8_t CSC_FLAG_DICTIONARY = 0x20;
+constexpr std::size_t DICTIONARY_ID_SIZE = 4; // little-endian
+constexpr std::uint8_t CSC_KNOWN_FLAGS = CSC_FLAG_BLOCKS | CSC_FLAG_ARCHIVE | CSC_FLAG_STREAM
+    | CSC_FLAG_STORED | CSC_FLAG_CHECKSUM | CSC_FLAG_DICTIONARY;
+
+// Parsed header of a version 1 or version 2 compressed file
+struct CscHeader {
+    std::uint8_t version;
+    std::uint8_t flags;
+    std::uint64_t originalLen;
+    std::string ext;
+    std::vector<HuffCode> codes;
+    // CRC32C of the original data, for single-stream files with CSC_FLAG_CHECKSUM
+    std::uint32_t checksum = 0;
+    // the dictionary and table holding the code lengths, with CSC_FLAG_DICTIONARY
+    std::uint32_t dictionaryId = 0;
+    std::uint8_t dictionaryTable = 0;
+};
+
+// Bounds-checked reader over bytes already in memory
+class ByteCursor {
+    public:
+        ByteCursor(const std::byte* data, const std::size_t length);
+
+        unsigned char next();
+
+        // returns the current position and skips n bytes
+        const std::byte* take(const std::size_t n);
+
+        std::size_t remaining() const;
+
+    private:
+        const std::byte* pos;
+        const std::byte* end;
+};
+
+void putVarint(std::vector<std::byte>& out, std::uint64_t value);
+
+void putLittleEndian32(std::vector<std::byte>& out, const std::uint32_t value);
+
+void putLittleEndian64(std::vector<std::byte>& out, const std::uint64_t value);
+
+std::uint64_t readVarint(std::istream& rf);
+
+std::uint64_t readVarint(ByteCursor& cur);
+
+std::uint32_t loadLittleEndian32(const std::byte* p);
+
+std::uint64_t readLittleEndian64(std::istream& rf);
+
+void packCodeLengths(
+    std::vector<std::byte>& out, const std::vector<std::uint8_t>& lengths);
+
+std::vector<std::uint8_t> unpackCodeLengths(
+    std::istream& rf, const std::size_t alphabetSize);
+
+std::vector<std::uint8_t> unpackCodeLengths(
+    ByteCursor& cur, const std::size_t alphabetSize);
+
+/* A single-stream header; with a checksum (the CRC32C of the original
+data) it also sets CSC_FLAG_CHECKSUM. */
+std::vector<std::byte> genHeaderBytesV2(
+    const std::string ext, const std::uint64_t n_total_chars,
+    const std::vector<std::uint8_t>& codeLengths,
+    const std::optional<std::uint32_t> checksum = std::nullopt);
+
+/* A single-stream header that names one table of the dictionary with this ID
+instead of storing code lengths. */
+std::vector<std::byte> genDictionaryHeaderBytes(
+    const std::string ext, const std::uint64_t n_total_chars,
+    const std::uint32_t dictionaryId, const std::uint8_t table,
+    const std::optional<std::uint32_t> checksum = std::nullopt);
+
+// Header of a file whose payload is a sequence of blocks (see blocks.hpp)
+std::vector<std::byte> genBlockedHeaderBytes(
+    const std::string ext, const std::uint64_t n_total_chars,
+    const std::uint8_t extraFlags = 0);
+
+// Header of a CSC_FLAG_STORED file, whose payload is the n_total_chars original bytes
+std::vector<std::byte> genStoredHeaderBytes(
+    const std::string ext, const std::uint64_t n_total_chars,
+    const std::optional<std::uint32_t> checksum = std::nullopt);
+
+// Reads either header version, leaving rf at the start of the payload.
+// codes is only filled in for single-stream files that aren't stored and
+// don't use a dictionary (see useDictionary).
+CscHeader readHeader(std::istream& rf);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef HISTOGRAM
+#define HISTOGRAM
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+constexpr std::size_t HISTOGRAM_TABLES = 4;
+
+/* Adds the count of every byte value in data to freqs (256 entries).
+Runs of one byte value would make each increment wait on the one before,
+so consecutive bytes go to HISTOGRAM_TABLES separate count tables that
+are summed at the end. */
+void countBytes(const std::byte* data, const std::size_t n, std::uint64_t* freqs);
+
+// Byte value counts of data, indexed by byte value
+std::vector<std::uint64_t> byteHistogram(const std::byte* data, const std::size_t n);
+
+/* Order-0 entropy of data with these symbol counts, in bits: a lower bound
+on the size of any prefix code for it. */
+double entropyBits(const std::vector<std::uint64_t>& freqs);
+
+#endif
@@ -1,36 +1,73 @@
 #ifndef HUFFER
 #define HUFFER
 #include <map>
-#include <queue>
 #include <fstream>
 #include <iostream>
 #include <filesystem>
 #include <bitset>
 #include <climits>
+#include <codetable.hpp>
+#include <hufftree.hpp>
 
-constexpr std::size_t IO_BUFFER_SIZE = 512; // == 512 bytes
+constexpr std::size_t IO_BUFFER_SIZE = 1 << 20; // == 1 MiB per read or write when streaming
 constexpr bool ERR_ON_OVERWRITES = true;
 const std::string COMPRESSION_EXT = ".csc";
-
-class HuffNode {
-    public:
-        HuffNode* left;
-        HuffNode* right;
-        std::byte data;
-        std::size_t freq;
-
-        HuffNode(const std::byte character, const std::size_t frequency);
-
-        HuffNode(HuffNode* leftChild, HuffNode* rightChild);
-
-};
-
-// HuffNode comparator class
-class Compare {
-public:
-    inline bool operator()(HuffNode* a, HuffNode* b) {
-        return a->freq > b->freq;
-    }
+const std::string STDIO_PATH = "-"; // standard input or output in place of a path
+constexpr unsigned DEFAULT_MAX_CODE_LENGTH = 15;
+constexpr unsigned MIN_MAX_CODE_LENGTH = 8;  // 256 symbols need 8 bits
+constexpr unsigned MAX_MAX_CODE_LENGTH = 32;
+constexpr std::size_t DEFAULT_BLOCK_SIZE = 1 << 20; // == 1 MiB
+// no block holds more, so decoders can reject a larger RAW_SIZE before allocating it
+constexpr std::size_t MAX_BLOCK_SIZE = 1 << 28; // == 256 MiB
+constexpr std::uint64_t WHOLE_FILE = UINT64_MAX;
+constexpr unsigned MIN_LEVEL = 1;
+constexpr unsigned MAX_LEVEL = 9;
+constexpr unsigned DEFAULT_LEVEL = 6;
+constexpr unsigned BEST_DICTIONARY_TABLE = UINT_MAX; // pick the table by estimated size
+// data Huffman coding would shrink by less than this fraction is stored as is
+constexpr double MIN_CODING_GAIN = 1.0 / 64;
+
+class ThreadPool;
+struct CscStats;
+struct CscDictionary;
+
+// Settings shared by the compression and decompression entry points
+struct CscOptions {
+    /* how hard to work on code tables, from MIN_LEVEL (fastest) to MAX_LEVEL
+    (smallest output); see levels.hpp for what each level does */
+    unsigned level = DEFAULT_LEVEL;
+    unsigned maxCodeLength = DEFAULT_MAX_CODE_LENGTH;
+    // inputs larger than this are split into independently coded blocks (0 = never)
+    std::size_t blockSize = DEFAULT_BLOCK_SIZE;
+    // code each block as INTERLEAVED_STREAMS bitstreams, for faster decoding
+    bool interleave = false;
+    // order-1 context clusters per block (0 = off), used where they beat one table
+    unsigned contextClusters = 0;
+    // store CRC32C checksums of the original data, checked when decompressing
+    bool checksums = true;
+    // decompress only to check the data, without writing any output
+    bool testOnly = false;
+    /* when compressing a directory, only recompress files that changed since
+    the last run, and delete the outputs of removed files (see incremental.hpp) */
+    bool incremental = false;
+    /* shared tables (see dictionary.hpp) that single-stream files can be
+    coded with instead of their own, and that decompressing them needs */
+    const CscDictionary* dictionary = nullptr;
+    // the dictionary table to code every file with, skipping the counting pass
+    unsigned dictionaryTable = BEST_DICTIONARY_TABLE;
+    // LZ77 match search level per block (0 = off), used where it beats the other block types
+    unsigned lzLevel = 0;
+    // worker threads for files and blocks (0 = one per hardware thread)
+    std::size_t threads = 0;
+    // pool shared by every task in a batch, or nullptr to make one as needed
+    ThreadPool* pool = nullptr;
+    // counters shared by every task in a run, or nullptr to skip instrumenting it
+    CscStats* stats = nullptr;
+    // the part of the original data to write when decompressing
+    std::uint64_t rangeStart = 0;
+    std::uint64_t rangeLength = WHOLE_FILE;
+    // archive members (or directories of them) to extract, empty for all
+    std::vector<std::string> members = std::vector<std::string>();
 };
 
 enum class ENDIAN
@@ -48,30 +85,26 @@ enum class ENDIAN
 
 std::vector<std::byte> stringToPaddedBytes(const std::string str);
 
-std::size_t fillBuffer(
-    std::byte* arr, const std::size_t arrLen, const std::string code);
-
-void encodeFrequencies(
-    HuffNode* root, std::string code, std::map<std::byte, std::string>& output);
-
-void encodeFrequencies(
-    HuffNode* root, std::map<std::byte, std::string>& codeTable);
-
-template <class A, class B, class C>
-A topPop(std::priority_queue<A, B, C>& pq) {
-         auto top = pq.top();
-         pq.pop();
-         return top;
+/* Huffman code lengths for a flat frequency table, falling back to
+package-merge when the tree has codes longer than maxLength bits
+(or the alphabet is too big for a HuffTree). Without exactLimit,
+over-long trees are cut down with clampedCodeLengths instead. */
+std::vector<std::uint8_t> huffmanCodeLengths(
+    const std::vector<std::uint64_t>& freqs, const unsigned maxLength,
+    const bool exactLimit = true);
+
+// Whether options ask for a block type, so even inputs of one block are written as blocks
+inline bool needsBlocks(const CscOptions& options) {
+    return options.interleave || options.contextClusters > 0 || options.lzLevel > 0;
 }
 
-inline bool isTreeLeaf(HuffNode* node) {
-    return node->left == nullptr;
+/* Whether n bytes are better stored than coded in codedBytes (code table
+included). Checking the entropy first skips building a tree for data that
+can't be compressed; the exact size is checked once the lengths are known. */
+inline bool tooLittleGain(const double codedBytes, const std::uint64_t n) {
+    return codedBytes > n * (1 - MIN_CODING_GAIN);
 }
 
-HuffNode* newTree(const std::map<std::byte, std::size_t>& freqTable);
-
-void delTree(HuffNode* root);
-
 std::map<std::byte, std::size_t> getByteFrequencies(
     std::ifstream& rf, std::size_t& counter);
 
@@ -80,6 +113,7 @@ std::map<std::byte, std::size_t> getByteFrequencies(
 
 std::string padByteCode(const std::string code);
 
+
 inline std::size_t minByteCount(const std::size_t nBits) {
     return (nBits % CHAR_BIT != 0) ? (nBits / CHAR_BIT) + 1 : (nBits / CHAR_BIT);
 }
@@ -88,11 +122,21 @@ std::vector<std::byte> genHeaderBytes(
     const std::string ext, const std::size_t n_total_chars, 
     const std::map<std::byte, std::string>& codeTable);
 
-void createDirsIfNeeded(const std::string& path);
+// Writes a whole message at once so lines from parallel tasks don't interleave
+void printMessage(std::ostream& os, const std::string& message);
+
+void createDirsIfNeeded(const std::string& filePath, const bool verbose);
 
 void writeToFile(const std::vector<std::byte>& bytes,
                  const std::string outputFile, const bool append);
 
+void writeCompFile(
+    const std::string inputFile,
+    const std::string outputFile, 
+    const bool verbose,
+    const bool errOnExistingOutput,
+    const CscOptions& options);
+
 void writeCompFile(
     const std::string inputFile,
     const std::string outputFile, 
@@ -102,6 +146,13 @@ void writeCompFile(
 void writeCompFile(
     const std::string inputFile, const std::string outputFile, const bool verbose);
 
+void writeDecompFile(
+    const std::string inputFile, 
+    const std::string outputFile,
+    const bool verbose, 
+    const bool errOnExistingOutput,
+    const CscOptions& options);
+
 void writeDecompFile(
     const std::string inputFile, 
     const std::string outputFile,
@@ -111,6 +162,29 @@ void writeDecompFile(
 void writeDecompFile(
     const std::string comp, const std::string decodeFilename, const bool verbose);
 
+/* Compresses rf to wf in one pass, holding only the blocks in flight in
+memory. The output is a CSC_FLAG_STREAM file, so rf needn't be seekable
+and its length needn't be known. */
+void compressStream(
+    std::istream& rf, std::ostream& wf, const std::string& ext, const CscOptions& options);
+
+// Decompresses any non-archive file from rf to wf, reading rf once
+void decompressStream(std::istream& rf, std::ostream& wf, const CscOptions& options);
+
+// compressStream or decompressStream between paths, where STDIO_PATH is stdin/stdout
+void processStream(
+    const std::string& inputFile,
+    const std::string& outputFile,
+    const bool decode,
+    const CscOptions& options);
+
+void processFile(
+        const std::string& filePath, 
+        const std::string& outputFile, 
+        const bool decode,
+        const bool verbose,
+        const CscOptions& options);
+
 void processFile(
         const std::string& filePath, 
         const std::string& outputFile, 
@@ -120,13 +194,30 @@ void processFile(
 void processFile(
     const std::string& filePath, const std::string& outputFile, const bool decode);
 
-void processDirectory(
+// processFile, reporting any error on std::cerr instead of throwing it
+bool tryProcessFile(
+        const std::string& filePath, 
+        const std::string& outputFile, 
+        const bool decode,
+        const bool verbose,
+        const CscOptions& options);
+
+/* Processes every matching file in dirPath concurrently, largest first.
+A file that fails is reported and skipped; returns the number of failures. */
+std::size_t processDirectory(
+        const std::string& dirPath, 
+        const std::string& outputDir, 
+        const bool decode, 
+        const bool verbose,
+        const CscOptions& options);
+
+std::size_t processDirectory(
         const std::string& dirPath, 
         const std::string& outputDir, 
         const bool decode, 
         const bool verbose);
 
-void processDirectory(
+std::size_t processDirectory(
     const std::string& dirPath, const std::string& outputDir, const bool decode);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef HUFFTREE
+#define HUFFTREE
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+constexpr std::size_t MAX_TREE_LEAVES = 256;
+constexpr std::size_t MAX_TREE_NODES = 2 * MAX_TREE_LEAVES - 1; // == 511
+constexpr std::int16_t TREE_NO_CHILD = -1;
+
+// One node of a HuffTree; leaves have left == right == TREE_NO_CHILD
+struct TreeNode {
+    std::uint64_t freq;
+    std::int16_t left;
+    std::int16_t right;
+    std::uint16_t symbol;
+};
+
+/* Huffman tree stored in a fixed array with index links, so building one
+never touches the heap and one object can be rebuilt for file after file.
+Leaves come first, sorted by frequency, then the internal nodes in the
+order they were merged, so every child comes before its parent and the
+root is the last node. */
+class HuffTree {
+    public:
+        /* Rebuilds the tree for freqs[0, alphabetSize), leaving out symbols
+        with a count of 0. alphabetSize can be at most MAX_TREE_LEAVES. */
+        void build(const std::uint64_t* freqs, const std::size_t alphabetSize);
+
+        // Writes every symbol's depth to lengths (0 if absent, 1 for a lone symbol)
+        void codeLengths(std::uint8_t* lengths) const;
+
+        std::size_t size() const;
+
+        // index of the root node, or TREE_NO_CHILD for an empty tree
+        std::int16_t root() const;
+
+        const TreeNode& node(const std::size_t i) const;
+
+    private:
+        std::array<TreeNode, MAX_TREE_NODES> nodes;
+        std::size_t numNodes = 0;
+        std::size_t numLeaves = 0;
+};
+
+#endif
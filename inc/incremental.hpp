@@ -0,0 +1,57 @@
+#ifndef INCREMENTAL
+#define INCREMENTAL
+#include <cstdint>
+#include <map>
+#include <string>
+#include <huffer.hpp>
+
+/*
+Incremental Manifest Notation (INCREMENTAL_MANIFEST_NAME in an output directory): ITEM [BYTE LENGTH OF ITEM]
+#####
+MAGIC [8]
+VERSION [1]
+OPTIONS [4]   optionsFingerprint of the run that wrote it
+NUM_ENTRIES [VARINT]
+(  NAME_LENGTH [VARINT]
+   NAME [NAME_LENGTH]   the input's file name
+   SIZE [VARINT]
+   MTIME [8]   the file system's own timestamp, little-endian two's complement
+   HASH [4]   CRC32C of the input's contents  )[NUM_ENTRIES]
+CHECKSUM [4]   CRC32C of everything before it
+Only inputs compressed without error are listed, so failures are retried.
+*/
+const std::string INCREMENTAL_MANIFEST_NAME = ".csc-manifest";
+constexpr std::size_t INCREMENTAL_MAGIC_SIZE = 8;
+constexpr unsigned char INCREMENTAL_MAGIC[INCREMENTAL_MAGIC_SIZE] = {
+    0x89, 'C', 'S', 'M', '\r', '\n', 0x1A, '\n'};
+constexpr std::uint8_t INCREMENTAL_VERSION = 1;
+
+// What an input looked like when it was last compressed
+struct SourceRecord {
+    std::uint64_t size;
+    std::int64_t mtime;
+    std::uint32_t hash;
+};
+
+// Records by input file name
+using SourceRecords = std::map<std::string, SourceRecord>;
+
+/* A hash of every option that changes the compressed output, so a run with
+different options doesn't trust outputs written by another. */
+std::uint32_t optionsFingerprint(const CscOptions& options);
+
+// The size and mtime of path, with hash left 0
+SourceRecord statSource(const std::string& path);
+
+// CRC32C of a whole file
+std::uint32_t hashFile(const std::string& path);
+
+/* The records in the manifest at path, or none if it's missing, damaged or
+written with other options: with no record every input is recompressed. */
+SourceRecords readIncrementalManifest(const std::string& path, const std::uint32_t fingerprint);
+
+// Replaces the manifest at path (through a temporary file, so it's never half written)
+void writeIncrementalManifest(
+    const std::string& path, const SourceRecords& records, const std::uint32_t fingerprint);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef LEVELS
+#define LEVELS
+#include <huffer.hpp>
+
+/*
+Compression Levels (CscOptions::level)
+#####
+1-3   count only every 16th, 8th or 4th HISTOGRAM_SAMPLE_STRETCH bytes of
+      data of at least MIN_SAMPLED_SIZE bytes, cut over-long codes with
+      clampedCodeLengths, and keep coding blocks with the previous block's
+      table while it's within REUSE_TABLE_SLACK of their entropy
+4     exact counts, over-long codes cut with clampedCodeLengths
+5-6   exact counts and optimal length-limited codes, and data is cut into
+      more blocks where its byte distribution shifts (see split.hpp); 6 is
+      the default
+7     as 6, and blocks also try the context model (DEFAULT_CONTEXT_CLUSTERS)
+8-9   as 7, and blocks also try LZ (DEFAULT_LZ_LEVEL, then MAX_LZ_LEVEL)
+-ctx and -lz settings given explicitly are kept at every level. Levels only
+change how data is coded, never the format, so any level decodes the same.
+*/
+constexpr unsigned MAX_FAST_LEVEL = 3;
+constexpr unsigned MAX_CLAMPED_LEVEL = 4;
+constexpr unsigned MIN_SPLIT_LEVEL = 5;
+constexpr unsigned MIN_CONTEXT_TRYING_LEVEL = 7;
+constexpr unsigned MIN_LZ_TRYING_LEVEL = 8;
+constexpr std::size_t HISTOGRAM_SAMPLE_STRETCH = 4096;
+// smaller data is always counted in full, since a sample would miss too much of it
+constexpr std::size_t MIN_SAMPLED_SIZE = 1 << 16;
+constexpr double REUSE_TABLE_SLACK = 1.0 / 32;
+
+/* options with the block types their level tries filled in, where they're
+off. Every compression entry point applies it before choosing between
+blocks and a single stream, since these block types make data blocks. */
+CscOptions levelOptions(const CscOptions& options);
+
+/* Byte value counts of data as options.level counts them: exact, or at fast
+levels estimated from a sample, scaled up to n bytes and with every byte
+value counted at least once, so codes built from them can code any byte. */
+std::vector<std::uint64_t> levelHistogram(
+    const std::byte* data, const std::size_t n, const CscOptions& options);
+
+// Whether levelHistogram estimates data's counts from a sample
+inline bool sampledHistogram(const std::size_t n, const CscOptions& options) {
+    return options.level <= MAX_FAST_LEVEL && n >= MIN_SAMPLED_SIZE;
+}
+
+// huffmanCodeLengths, limiting code lengths as exactly as options.level asks
+std::vector<std::uint8_t> levelCodeLengths(
+    const std::vector<std::uint64_t>& freqs, const CscOptions& options);
+
+/* Whether a fast level keeps coding with lengths (built for earlier data)
+data whose counts are freqs, rather than building a table of its own. */
+bool keepTable(
+    const std::vector<std::uint64_t>& freqs, const std::vector<std::uint8_t>& lengths,
+    const CscOptions& options);
+
+#endif
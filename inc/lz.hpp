@@ -0,0 +1,56 @@
+#ifndef LZ
+#define LZ
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <codetable.hpp>
+
+/*
+LZ77 Token Coding Notation (the coded bits of a BLOCK_LZ body, see blocks.hpp):
+Each token is either a literal byte or a match that copies LENGTH bytes from
+DISTANCE bytes back. Tokens are coded with two Huffman tables:
+   LITLEN: symbols 0-255 are literals, 256 + C starts a match whose
+           LENGTH - LZ_MIN_MATCH has bucket code C
+   DISTANCE: the bucket code of DISTANCE - 1
+A value v has bucket code v when v < 4; otherwise, with n = floor(log2(v)),
+its code is 2n + (bit n - 1 of v), followed by the low n - 1 bits of v as
+extra bits, MSB first. A match is LITLEN code, length extra bits, DISTANCE
+code, distance extra bits. Tokens run until the block's RAW_SIZE bytes are made.
+*/
+constexpr unsigned LZ_MIN_MATCH = 4;
+constexpr unsigned LZ_LENGTH_CODES = 32;   // lengths up to LZ_MIN_MATCH + 2^16 - 1
+constexpr unsigned LZ_DISTANCE_CODES = 40; // distances up to LZ_WINDOW_SIZE
+constexpr std::size_t LZ_LITLEN_SYMBOLS = 256 + LZ_LENGTH_CODES;
+constexpr std::uint32_t LZ_MAX_MATCH = LZ_MIN_MATCH + (1 << 16) - 1;
+constexpr std::uint32_t LZ_WINDOW_SIZE = 1 << 20;
+constexpr unsigned MIN_LZ_LEVEL = 1;
+constexpr unsigned MAX_LZ_LEVEL = 9;
+constexpr unsigned DEFAULT_LZ_LEVEL = 6;
+
+// A literal byte (distance == 0, length holds the byte) or a match
+struct LzToken {
+    std::uint32_t length;
+    std::uint32_t distance;
+};
+
+/* Splits data into literals and matches with a hash-chain match finder.
+Higher levels (MIN_LZ_LEVEL to MAX_LZ_LEVEL) search longer chains and
+defer matches that a match one byte later beats (lazy matching). n must fit
+in 32 bits, as the match finder holds positions in them. */
+std::vector<LzToken> lzParse(const std::byte* data, const std::size_t n, const unsigned level);
+
+// Adds the LITLEN and DISTANCE symbol counts of tokens to the two tables
+void countLzSymbols(
+    const std::vector<LzToken>& tokens,
+    std::vector<std::uint64_t>& litlenFreqs, std::vector<std::uint64_t>& distanceFreqs);
+
+void encodeLzTokens(
+    const std::vector<LzToken>& tokens, const EncodeTable& litlen,
+    const EncodeTable& distance, BitWriter& bw);
+
+// Decodes tokens until n bytes are written to out, checking every match
+void decodeLzTokens(
+    const DecodeTable& litlen, const DecodeTable& distance,
+    BitReader& br, std::byte* out, const std::size_t n);
+
+#endif
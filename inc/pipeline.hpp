@@ -0,0 +1,134 @@
+#ifndef PIPELINE
+#define PIPELINE
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+struct CscStats;
+
+// chunks an I/O stage may hold ahead of the coders (or behind them, for writes)
+constexpr std::size_t PIPELINE_DEPTH = 4;
+
+/* A FIFO of at most capacity items between two threads. push waits while
+it's full and pop while it's empty; after close, push drops its item and
+returns false, and pop returns false once the queue is drained. */
+template <class T>
+class BoundedQueue {
+    public:
+        explicit BoundedQueue(const std::size_t capacity) : capacity(capacity) {}
+
+        bool push(T item) {
+            std::unique_lock<std::mutex> guard(lock);
+            notFull.wait(guard, [&]() { return closed || items.size() < capacity; });
+            if (closed)
+                return false;
+            items.push_back(std::move(item));
+            notEmpty.notify_one();
+            return true;
+        }
+
+        bool pop(T& item) {
+            std::unique_lock<std::mutex> guard(lock);
+            notEmpty.wait(guard, [&]() { return closed || !items.empty(); });
+            if (items.empty())
+                return false;
+            item = std::move(items.front());
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+            notEmpty.notify_all();
+            notFull.notify_all();
+        }
+
+    private:
+        const std::size_t capacity;
+        std::deque<T> items;
+        bool closed = false;
+        std::mutex lock;
+        std::condition_variable notEmpty;
+        std::condition_variable notFull;
+};
+
+/* Reader stage: a thread that reads rf ahead in chunks of chunkSize bytes,
+up to limit bytes in all (UINT64_MAX for the whole stream), so the reads
+overlap with whatever the caller does with the chunks before them. Without
+threaded, next reads each chunk itself and no thread is started. */
+class AsyncReader {
+    public:
+        AsyncReader(std::istream& rf, const std::size_t chunkSize, const std::uint64_t limit,
+                    CscStats* stats, const bool threaded = true);
+
+        // stops reading, dropping any chunks read ahead
+        ~AsyncReader();
+
+        AsyncReader(const AsyncReader&) = delete;
+        AsyncReader& operator=(const AsyncReader&) = delete;
+
+        /* Sets chunk to the next chunk and returns true, or returns false at
+        the end of the stream. Only the last chunk can be short. Rethrows a
+        read error. */
+        bool next(std::vector<std::byte>& chunk);
+
+    private:
+        // reads the next chunk into chunk, returning false at the end
+        bool read(std::vector<std::byte>& chunk);
+
+        void run();
+
+        std::istream& rf;
+        const std::size_t chunkSize;
+        std::uint64_t limit;
+        bool ended = false;
+        BoundedQueue<std::vector<std::byte>> chunks;
+        std::exception_ptr error = nullptr;
+        CscStats* stats;
+        std::thread thread;
+};
+
+/* Writer stage: a thread that writes chunks to wf in the order they're
+given, flushing after each, so the writes overlap with making the next
+chunks. write waits while PIPELINE_DEPTH chunks are queued. Without
+threaded, as for sinks in memory, write writes the chunk itself. */
+class AsyncWriter {
+    public:
+        AsyncWriter(std::ostream& wf, CscStats* stats, const bool threaded = true);
+
+        // waits for queued chunks to be written, but doesn't report errors (see finish)
+        ~AsyncWriter();
+
+        AsyncWriter(const AsyncWriter&) = delete;
+        AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+        // Rethrows an earlier write error, if there was one
+        void write(std::vector<std::byte> chunk);
+
+        // Waits until everything is written, then rethrows any write error
+        void finish();
+
+    private:
+        // throws if the chunk can't be written
+        void writeChunk(const std::vector<std::byte>& chunk);
+
+        void run();
+
+        std::ostream& wf;
+        BoundedQueue<std::vector<std::byte>> chunks;
+        std::mutex errorLock;
+        std::exception_ptr error = nullptr;
+        CscStats* stats;
+        std::thread thread;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef SPLIT
+#define SPLIT
+#include <levels.hpp>
+
+/*
+Adaptive block splitting: data whose byte distribution shifts partway (a
+text header before a binary payload, say) codes smaller as several blocks,
+each with its own table. findSplits slides a lookahead histogram of
+SPLIT_LOOKAHEAD_WINDOWS windows of SPLIT_WINDOW_SIZE bytes along the data
+and ends the current part where coding the lookahead with a table of its
+own is estimated to save more than MIN_SPLIT_GAIN of it, table and frame
+costs included, over coding it with the current part's table. Parts only
+change how blocks are cut, so the decoder does no extra work.
+*/
+constexpr std::size_t SPLIT_WINDOW_SIZE = 1 << 14;
+constexpr std::size_t SPLIT_LOOKAHEAD_WINDOWS = 4;
+// splits must save this fraction of the lookahead, so noise in the counts of a steady distribution doesn't split it
+constexpr double MIN_SPLIT_GAIN = 1.0 / 128;
+// frame header and checksum bytes another block adds, as estimated
+constexpr double SPLIT_FRAME_COST = 12;
+
+/* Whether options have data of n bytes cut where its distribution shifts
+(never with a blockSize of 0, which asks for no splitting at all, nor when
+a part could outgrow MAX_BLOCK_SIZE) */
+inline bool splitsBlocks(const std::size_t n, const CscOptions& options) {
+    return options.level >= MIN_SPLIT_LEVEL && options.blockSize > 0 && n >= 2 * SPLIT_WINDOW_SIZE
+        && n <= MAX_BLOCK_SIZE;
+}
+
+/* Estimated size of a block of n bytes with counts freqs: order-0 entropy
+plus about a byte of packed code table per byte value used, or n stored
+bytes if that's less, plus the frame around it. */
+double estimatedBlockBytes(const std::vector<std::uint64_t>& freqs, const std::uint64_t n);
+
+// A part of data to code as a block of its own, with its byte counts
+struct SplitPart {
+    std::size_t n;
+    std::vector<std::uint64_t> freqs;
+};
+
+/* The parts to code data in, in order: just one of n bytes when there's no
+shift worth a block of its own. Every part but the last is a whole number
+of windows. Their counts are sums of the window counts, so callers needn't
+count the data again. */
+std::vector<SplitPart> findSplits(const std::byte* data, const std::size_t n, CscStats* stats);
+
+#endif
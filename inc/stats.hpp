@@ -0,0 +1,109 @@
+#ifndef STATS
+#define STATS
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// The parts of compressing and decompressing that CscStats times
+enum class Phase {
+    histogram,   // counting byte values
+    model,       // LZ match finding and context clustering
+    codeLengths, // building Huffman trees or package-merge
+    header,      // generating and packing headers and code tables
+    encode,
+    decode,
+    checksum,    // computing and verifying CRC32C checksums
+    io,          // reading input and writing output outside the coders
+    count
+};
+
+// Sets value to candidate if that's larger
+inline void raiseTo(std::atomic<unsigned>& value, const unsigned candidate) {
+    unsigned seen = value.load(std::memory_order_relaxed);
+    while (candidate > seen && !value.compare_exchange_weak(seen, candidate, std::memory_order_relaxed))
+        ;
+}
+
+/* Counters shared by every task of a run (through CscOptions::stats) and
+updated with relaxed atomics. Phase times are summed over threads, so with
+several workers they can add up to more than the wall time. Bytes in
+aren't known when decompressing standard input. */
+struct CscStats {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::atomic<std::uint64_t> phaseNanos[(std::size_t) Phase::count] = {};
+    std::atomic<std::uint64_t> files{0};
+    std::atomic<std::uint64_t> blocks{0};
+    std::atomic<std::uint64_t> bytesIn{0};
+    std::atomic<std::uint64_t> bytesOut{0};
+    // code tables built, so a table reused for several blocks counts once
+    std::atomic<std::uint64_t> codeTables{0};
+    // the most symbols and longest code of any one code table
+    std::atomic<unsigned> maxSymbols{0};
+    std::atomic<unsigned> maxCodeLength{0};
+};
+
+// Adds n to one counter of stats, if there are stats
+inline void addStat(
+        CscStats* stats, std::atomic<std::uint64_t> CscStats::* counter, const std::uint64_t n) {
+    if (stats != nullptr)
+        (stats->*counter).fetch_add(n, std::memory_order_relaxed);
+}
+
+// Records one code table built, with its symbol count and longest code
+template <class Lengths>
+void noteCodeLengths(CscStats* stats, const Lengths& lengths) {
+    if (stats == nullptr)
+        return;
+    stats->codeTables.fetch_add(1, std::memory_order_relaxed);
+    unsigned symbols = 0, longest = 0;
+    for (auto len : lengths) {
+        symbols += len > 0;
+        longest = len > longest ? len : longest;
+    }
+    raiseTo(stats->maxSymbols, symbols);
+    raiseTo(stats->maxCodeLength, longest);
+}
+
+/* Adds the time from construction to destruction to one phase of stats.
+With no stats (nullptr) it doesn't read the clock at all. */
+class PhaseTimer {
+    public:
+        PhaseTimer(CscStats* stats, const Phase phase) : stats(stats), phase(phase) {
+            if (stats != nullptr)
+                begin = std::chrono::steady_clock::now();
+        }
+
+        ~PhaseTimer() {
+            if (stats != nullptr)
+                stats->phaseNanos[(std::size_t) phase].fetch_add((std::uint64_t)
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - begin).count(),
+                    std::memory_order_relaxed);
+        }
+
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    private:
+        CscStats* stats;
+        Phase phase;
+        std::chrono::steady_clock::time_point begin;
+};
+
+// Runs f as one timed phase of stats and returns its result
+template <class F>
+auto timePhase(CscStats* stats, const Phase phase, F f) -> decltype(f()) {
+    PhaseTimer timer(stats, phase);
+    return f();
+}
+
+const char* phaseName(const Phase phase);
+
+// A human-readable summary of stats, one item per line
+std::string statsText(const CscStats& stats);
+
+// stats as a single-line JSON object
+std::string statsJson(const CscStats& stats);
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef THREADPOOL
+#define THREADPOOL
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Resolves a requested thread count, where 0 means one per hardware thread
+std::size_t resolveThreadCount(const std::size_t requested);
+
+/* Work-stealing pool of worker threads.
+Tasks submitted from a worker go on that worker's own deque and tasks from
+other threads go on a shared queue. A worker runs its own tasks first, then
+shared ones, then steals from the other workers; every queue is taken
+oldest first, so work submitted in priority order starts in that order.
+A worker that waits on a task result keeps running other tasks meanwhile,
+so tasks can submit and wait on subtasks without starving the pool, and
+sleeps while there are none. */
+class ThreadPool {
+    public:
+        explicit ThreadPool(const std::size_t numThreads);
+
+        // runs every task still queued before joining the workers
+        ~ThreadPool();
+
+        template <class F>
+        auto submit(F task) -> std::future<decltype(task())> {
+            using R = decltype(task());
+            auto packaged = std::make_shared<std::packaged_task<R()>>(std::move(task));
+            std::future<R> result = packaged->get_future();
+            push([packaged]() { (*packaged)(); });
+            return result;
+        }
+
+        template <class R>
+        R wait(std::future<R>& result) {
+            if (currentPool == this) {
+                auto ready = [&]() {
+                    return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                };
+                while (!ready()) {
+                    if (runPending())
+                        continue;
+                    // nothing to run, so sleep until a task is queued or one finishes
+                    std::unique_lock<std::mutex> guard(sleepLock);
+                    waiting++;
+                    progress.wait(guard, [&]() { return queued > 0 || ready(); });
+                    waiting--;
+                }
+            }
+            return result.get();
+        }
+
+        // waits for every result, then rethrows the first error (if any)
+        template <class R>
+        void waitAll(std::vector<std::future<R>>& results) {
+            std::exception_ptr firstError = nullptr;
+            for (std::future<R>& result : results) {
+                try {
+                    wait(result);
+                } catch (...) {
+                    if (!firstError)
+                        firstError = std::current_exception();
+                }
+            }
+            if (firstError)
+                std::rethrow_exception(firstError);
+        }
+
+        std::size_t size() const;
+
+    private:
+        struct WorkQueue {
+            std::deque<std::function<void()>> tasks;
+            std::mutex lock;
+        };
+
+        void push(std::function<void()> task);
+
+        bool tryTake(std::function<void()>& task);
+
+        // runs one queued task, if there is one
+        bool runPending();
+
+        void work(const std::size_t id);
+
+        std::vector<std::unique_ptr<WorkQueue>> queues;
+        WorkQueue shared;
+        std::vector<std::thread> workers;
+        std::atomic<std::size_t> queued{0};
+        std::mutex sleepLock;
+        std::condition_variable wake;
+        // for workers in wait: a task was queued or finished
+        std::condition_variable progress;
+        std::size_t waiting = 0; // workers sleeping on progress, under sleepLock
+        bool stopping = false;
+
+        static thread_local ThreadPool* currentPool;
+        static thread_local std::size_t currentId;
+};
+
+#endif
@@ -0,0 +1,338 @@
+#include <archive.hpp>
+#include <blocks.hpp>
+#include <threadpool.hpp>
+#include <stats.hpp>
+#include <levels.hpp>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+
+constexpr std::uint64_t MAX_MEMBER_PATH_LENGTH = 4096;
+
+// file_clock has no portable epoch before C++20, so convert through now()
+static std::int64_t toUnixTime(const std::filesystem::file_time_type t) {
+    using namespace std::chrono;
+    auto sys = t - std::filesystem::file_time_type::clock::now() + system_clock::now();
+    return round<seconds>(sys.time_since_epoch()).count();
+}
+
+static std::filesystem::file_time_type fromUnixTime(const std::int64_t secs) {
+    using namespace std::chrono;
+    auto sys = system_clock::time_point(seconds(secs));
+    auto t = sys - system_clock::now() + std::filesystem::file_time_type::clock::now();
+    // both clocks' epochs are whole seconds apart, so this undoes the drift
+    return std::filesystem::file_time_type(round<seconds>(t.time_since_epoch()));
+}
+
+// Rejects paths that would land outside the extraction directory
+static bool isSafeMemberPath(const std::string& path) {
+    std::filesystem::path p(path);
+    if (p.empty() || p.has_root_name() || p.has_root_directory())
+        return false;
+    for (const std::filesystem::path& part : p) {
+        if (part == "..")
+            return false;
+    }
+    return true;
+}
+
+/* Reads the members' files back to back as one stream, failing if a file
+no longer has the size recorded in the manifest. */
+class MemberStreamBuf : public std::streambuf {
+    public:
+        MemberStreamBuf(const std::string& root, const std::vector<ArchiveMember>& members) :
+            root(root), members(members), buffer(IO_BUFFER_SIZE) {}
+
+    protected:
+        int_type underflow() override {
+            while (remaining == 0) {
+                if (next == members.size())
+                    return traits_type::eof();
+                current = next++;
+                file.close();
+                file.open(memberPath(), std::ios::in | std::ios::binary);
+                if (!file)
+                    throw std::invalid_argument("Can't read " + memberPath());
+                remaining = members[current].size;
+            }
+            std::size_t n = (std::size_t) std::min<std::uint64_t>(buffer.size(), remaining);
+            file.read(buffer.data(), n);
+            if ((std::size_t) file.gcount() != n)
+                throw std::runtime_error(memberPath() + " changed while archiving");
+            remaining -= n;
+            setg(buffer.data(), buffer.data(), buffer.data() + n);
+            return traits_type::to_int_type(buffer[0]);
+        }
+
+    private:
+        std::string memberPath() const {
+            return (std::filesystem::path(root) / members[current].path).string();
+        }
+
+        std::string root;
+        const std::vector<ArchiveMember>& members;
+        std::vector<char> buffer;
+        std::ifstream file;
+        std::size_t current = 0;
+        std::size_t next = 0;
+        std::uint64_t remaining = 0;
+};
+
+std::vector<ArchiveMember> readManifest(std::istream& rf, const CscHeader& header) {
+    std::vector<ArchiveMember> members = std::vector<ArchiveMember>();
+    std::uint64_t numMembers = readVarint(rf);
+    std::uint64_t offset = 0;
+    for (std::uint64_t i = 0; i < numMembers; i++) {
+        std::uint64_t pathLen = readVarint(rf);
+        if (pathLen == 0 || pathLen > MAX_MEMBER_PATH_LENGTH)
+            throw std::runtime_error("Malformed archive manifest");
+        std::string path((std::size_t) pathLen, '\0');
+        rf.read(path.data(), pathLen);
+        if ((std::uint64_t) rf.gcount() != pathLen)
+            throw std::runtime_error("Unexpected end of archive manifest");
+        if (!isSafeMemberPath(path))
+            throw std::runtime_error("Unsafe member path " + path + " in archive");
+        std::uint64_t size = readVarint(rf);
+        std::int64_t mtime = (std::int64_t) readLittleEndian64(rf);
+        if (size > header.originalLen - offset)
+            throw std::runtime_error("Malformed archive manifest");
+        members.push_back({path, offset, size, mtime});
+        offset += size;
+    }
+    if (offset != header.originalLen)
+        throw std::runtime_error("Malformed archive manifest");
+    return members;
+}
+
+void writeArchive(
+        const std::string& dirPath,
+        const std::string& archiveFile,
+        const bool verbose,
+        const CscOptions& requested) {
+    const CscOptions options = levelOptions(requested);
+    if (verbose)
+        printMessage(std::cout, "Archiving " + dirPath + " to " + archiveFile + " ...\n");
+    if (std::filesystem::exists(archiveFile) && ERR_ON_OVERWRITES) {
+        printMessage(std::cerr, "Can't compress to existing file " + archiveFile + "\n");
+        return;
+    }
+    auto found = std::vector<std::pair<std::string, ArchiveMember>>();
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(dirPath)) {
+        if (!entry.is_regular_file())
+            continue;
+        std::filesystem::path relative = std::filesystem::relative(entry.path(), dirPath);
+        found.push_back({relative.extension().string(), {
+            relative.generic_string(), 0, entry.file_size(),
+            toUnixTime(entry.last_write_time())}});
+    }
+    // group files of the same type so they share blocks and code tables
+    std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first < b.first : a.second.path < b.second.path;
+    });
+    std::vector<ArchiveMember> members = std::vector<ArchiveMember>();
+    std::uint64_t total = 0;
+    for (auto& f : found) {
+        f.second.offset = total;
+        total += f.second.size;
+        members.push_back(f.second);
+    }
+    std::vector<std::byte> header = genBlockedHeaderBytes("", total, CSC_FLAG_ARCHIVE | checksumFlag(options));
+    // +NUM_MEMBERS
+    putVarint(header, members.size());
+    for (const ArchiveMember& m : members) {
+        // +PATH_LENGTH
+        putVarint(header, m.path.size());
+        // +PATH
+        for (char c : m.path)
+            header.push_back((std::byte) c);
+        // +SIZE
+        putVarint(header, m.size);
+        // +MTIME
+        putLittleEndian64(header, (std::uint64_t) m.mtime);
+    }
+    std::ofstream wf(archiveFile, std::ios::out | std::ios::binary);
+    if (!wf) {
+        throw std::invalid_argument("Can't compress to " + archiveFile);
+    }
+    wf.write(reinterpret_cast<const char*>(header.data()), header.size());
+    addStat(options.stats, &CscStats::files, 1);
+    addStat(options.stats, &CscStats::bytesOut, header.size());
+    MemberStreamBuf contents(dirPath, members);
+    std::istream rf(&contents);
+    rf.exceptions(std::ios::badbit);
+    try {
+        writeBlocks(rf, wf, header.size(), total, options);
+    } catch (...) {
+        // don't leave an archive that is missing members behind
+        wf.close();
+        std::filesystem::remove(archiveFile);
+        throw;
+    }
+    wf.close();
+}
+
+static std::vector<ArchiveMember> openArchive(
+        const std::string& archiveFile, CscHeader& header, std::uint64_t& payloadOffset) {
+    std::ifstream rf(archiveFile, std::ios::in | std::ios::binary);
+    if (!rf) {
+        throw std::invalid_argument("Can't read " + archiveFile);
+    }
+    header = readHeader(rf);
+    if (!(header.flags & CSC_FLAG_ARCHIVE))
+        throw std::invalid_argument(archiveFile + " is not an archive");
+    std::vector<ArchiveMember> members = readManifest(rf, header);
+    payloadOffset = (std::uint64_t) rf.tellg();
+    return members;
+}
+
+std::vector<ArchiveMember> listArchive(const std::string& archiveFile) {
+    CscHeader header;
+    std::uint64_t payloadOffset;
+    return openArchive(archiveFile, header, payloadOffset);
+}
+
+// A requested name selects that member or every member under that directory
+static bool isSelected(const ArchiveMember& m, const std::vector<std::string>& names) {
+    if (names.empty())
+        return true;
+    for (std::string name : names) {
+        while (name.size() > 1 && name.back() == '/')
+            name.pop_back();
+        if (m.path == name || m.path.compare(0, name.size() + 1, name + "/") == 0)
+            return true;
+    }
+    return false;
+}
+
+/* The output of a member spanning blocks, written by the task of each block
+it overlaps: the first one to write creates the file, the last one closes it */
+struct SpanningOutput {
+    std::mutex lock;
+    std::unique_ptr<PositionedFile> out;
+    std::size_t blocksLeft = 0;
+};
+
+static void writeSpanningSlice(
+        const ArchiveMember& m, const std::string& path, SpanningOutput& output,
+        const BlockInfo& info, const std::vector<std::byte>& raw) {
+    PositionedFile* out;
+    {
+        std::lock_guard<std::mutex> guard(output.lock);
+        if (!output.out) {
+            output.out = std::make_unique<PositionedFile>(path, true);
+            output.out->resize(m.size);
+        }
+        out = output.out.get();
+    }
+    std::uint64_t from = std::max(m.offset, info.rawOffset);
+    std::uint64_t to = std::min(m.offset + m.size, info.rawOffset + info.rawSize);
+    out->writeAt(from - m.offset, raw.data() + (from - info.rawOffset), to - from);
+    std::lock_guard<std::mutex> guard(output.lock);
+    if (--output.blocksLeft == 0) {
+        output.out.reset();
+        std::filesystem::last_write_time(path, fromUnixTime(m.mtime));
+    }
+}
+
+std::size_t extractArchive(
+        const std::string& archiveFile,
+        const std::string& outputDir,
+        const bool verbose,
+        const CscOptions& options) {
+    CscHeader header;
+    std::uint64_t payloadOffset;
+    std::vector<ArchiveMember> members = openArchive(archiveFile, header, payloadOffset);
+    for (const std::string& name : options.members) {
+        if (std::none_of(members.begin(), members.end(), [&](const ArchiveMember& m) {
+                return isSelected(m, {name});
+            }))
+            throw std::invalid_argument("No member " + name + " in " + archiveFile);
+    }
+    if (verbose)
+        printMessage(std::cout, "Extracting " + archiveFile + " to " + outputDir + " ...\n");
+    PositionedFile in(archiveFile, false);
+    std::vector<BlockInfo> blocks = readBlockIndex(in, header, payloadOffset);
+    auto blockOf = [&](const std::uint64_t offset) {
+        return (std::size_t) (std::upper_bound(blocks.begin(), blocks.end(), offset,
+            [](const std::uint64_t o, const BlockInfo& b) { return o < b.rawOffset; })
+            - blocks.begin() - 1);
+    };
+    // each block is decoded once, by a task writing every member it overlaps:
+    // whole files for members inside it, slices for members spanning blocks
+    std::map<std::size_t, std::vector<const ArchiveMember*>> byBlock;
+    std::map<const ArchiveMember*, SpanningOutput> spanning;
+    std::size_t skipped = 0;
+    std::uint64_t extracted = 0;
+    auto outputPath = [&](const ArchiveMember& m) {
+        return (std::filesystem::path(outputDir) / m.path).string();
+    };
+    for (const ArchiveMember& m : members) {
+        if (!isSelected(m, options.members))
+            continue;
+        std::string path = outputPath(m);
+        if (std::filesystem::exists(path) && ERR_ON_OVERWRITES) {
+            printMessage(std::cerr, "Can't decompress to existing file " + path + "\n");
+            skipped++;
+            continue;
+        }
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+        extracted += m.size;
+        if (m.size == 0) {
+            std::ofstream wf(path, std::ios::out | std::ios::binary);
+            if (!wf)
+                throw std::invalid_argument("Can't decompress to " + path);
+            wf.close();
+            std::filesystem::last_write_time(path, fromUnixTime(m.mtime));
+        } else {
+            const std::size_t first = blockOf(m.offset);
+            const std::size_t last = blockOf(m.offset + m.size - 1);
+            for (std::size_t b = first; b <= last; b++)
+                byBlock[b].push_back(&m);
+            if (last > first)
+                spanning[&m].blocksLeft = last - first + 1;
+        }
+    }
+    std::unique_ptr<ThreadPool> ownPool;
+    CscOptions taskOptions = options;
+    taskOptions.pool = &poolFor(options, ownPool);
+    std::vector<std::future<void>> results = std::vector<std::future<void>>();
+    for (const auto& group : byBlock) {
+        const BlockInfo& info = blocks[group.first];
+        const std::vector<const ArchiveMember*>& groupMembers = group.second;
+        CscStats* stats = taskOptions.stats;
+        results.push_back(taskOptions.pool->submit(
+                [&in, &info, &groupMembers, &outputPath, &spanning, stats]() {
+            std::vector<std::byte> raw = decodeBlock(in, info, stats);
+            for (const ArchiveMember* m : groupMembers) {
+                std::string path = outputPath(*m);
+                auto output = spanning.find(m);
+                if (output != spanning.end()) {
+                    writeSpanningSlice(*m, path, output->second, info, raw);
+                    continue;
+                }
+                std::ofstream wf(path, std::ios::out | std::ios::binary);
+                wf.write(reinterpret_cast<const char*>(raw.data() + (m->offset - info.rawOffset)),
+                         m->size);
+                wf.close();
+                if (!wf)
+                    throw std::invalid_argument("Can't decompress to " + path);
+                std::filesystem::last_write_time(path, fromUnixTime(m->mtime));
+            }
+        }));
+    }
+    // the tasks use in, blocks and spanning, so all of them must finish before returning
+    taskOptions.pool->waitAll(results);
+    addStat(options.stats, &CscStats::files, 1);
+    addStat(options.stats, &CscStats::bytesIn, in.size());
+    addStat(options.stats, &CscStats::bytesOut, extracted);
+    return skipped;
+}
+
+void testArchive(const std::string& archiveFile, const CscOptions& options) {
+    CscHeader header;
+    std::uint64_t payloadOffset;
+    openArchive(archiveFile, header, payloadOffset);
+    PositionedFile in(archiveFile, false);
+    testBlocks(in, readBlockIndex(in, header, payloadOffset), options);
+}
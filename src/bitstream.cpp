@@ -0,0 +1,76 @@
+#include <bitstream.hpp>
+
+BitReader::BitReader(std::istream& source) :
+    source(&source), buffer(BIT_READER_CHUNK_SIZE) {
+    pos = end = buffer.data();
+}
+
+BitReader::BitReader(const std::byte* data, const std::size_t length) :
+    source(nullptr), pos(data), end(data + length) {}
+
+void BitReader::refillSlow() {
+    while (count <= 56) {
+        if (pos == end && source != nullptr && *source) {
+            source->read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+            pos = buffer.data();
+            end = pos + source->gcount();
+            if (end - pos >= 8) {
+                refill();
+                return;
+            }
+        }
+        if (pos != end) {
+            bits |= ((std::uint64_t) *pos++) << (56 - count);
+        } else {
+            paddingBits += 8;
+        }
+        count += 8;
+    }
+}
+
+BitWriter::BitWriter(std::ostream& sink) :
+    sink(&sink), ownBuffer(BIT_WRITER_CHUNK_SIZE + 8), buffer(&ownBuffer), base(0) {
+    out = buffer->data();
+    limit = out + BIT_WRITER_CHUNK_SIZE;
+}
+
+BitWriter::BitWriter(std::vector<std::byte>& target) :
+    sink(nullptr), buffer(&target), base(target.size()) {
+    target.resize(base + BIT_WRITER_CHUNK_SIZE + 8);
+    out = target.data() + base;
+    limit = target.data() + target.size() - 8;
+}
+
+void BitWriter::drain() {
+    std::byte* start = buffer->data() + base;
+    std::size_t used = out - start;
+    if (sink != nullptr) {
+        sink->write(reinterpret_cast<const char*>(start), used);
+        drained += used;
+        out = start;
+    } else {
+        buffer->resize(base + 2 * used + 8);
+        out = buffer->data() + base + used;
+        limit = buffer->data() + buffer->size() - 8;
+    }
+}
+
+void BitWriter::finish() {
+    flush();
+    if (count > 0) {
+        storeBigEndian64(out, acc);
+        out += 1;
+        acc = 0;
+        count = 0;
+    }
+    if (sink != nullptr) {
+        drain();
+    } else {
+        buffer->resize(out - buffer->data());
+        out = limit = buffer->data() + buffer->size();
+    }
+}
+
+std::size_t BitWriter::bytesWritten() const {
+    return drained + (out - (buffer->data() + base));
+}
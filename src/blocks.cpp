@@ -0,0 +1,688 @@
+#include <blocks.hpp>
+#include <threadpool.hpp>
+#include <histogram.hpp>
+#include <context.hpp>
+#include <lz.hpp>
+#include <stats.hpp>
+#include <checksum.hpp>
+#include <pipeline.hpp>
+#include <levels.hpp>
+#include <split.hpp>
+#include <deque>
+#include <algorithm>
+#include <optional>
+
+static std::vector<std::byte> genFrame(
+        const std::uint8_t type, const std::size_t n,
+        const std::byte* body, const std::size_t bodyLen) {
+    std::vector<std::byte> frame = std::vector<std::byte>();
+    frame.reserve(bodyLen + 21);
+    // +BLOCK_TYPE
+    frame.push_back((std::byte) type);
+    // +RAW_SIZE
+    putVarint(frame, n);
+    // +BODY_SIZE
+    putVarint(frame, bodyLen);
+    // +BODY
+    frame.insert(frame.end(), body, body + bodyLen);
+    return frame;
+}
+
+/* Writes a BLOCK_CONTEXT body for data to body, unless it wouldn't be
+smaller than order0Bytes (the BLOCK_HUFFMAN body). Returns whether it did. */
+static bool compressContextBlock(
+        const std::byte* data, const std::size_t n, const CscOptions& options,
+        const double order0Bytes, std::vector<std::byte>& body) {
+    ContextModel model = timePhase(options.stats, Phase::model, [&]() {
+        return buildContextModel(data, n, options.contextClusters);
+    });
+    if (model.numClusters < 2)
+        return false;
+    // +NUM_CLUSTERS
+    body.push_back((std::byte) model.numClusters);
+    // +PACKED_CONTEXT_MAP
+    packCodeLengths(body, std::vector<std::uint8_t>(model.clusterOf, model.clusterOf + 256));
+    std::vector<EncodeTable> tables = std::vector<EncodeTable>();
+    std::uint64_t bits = 0;
+    for (const std::vector<std::uint64_t>& freqs : model.freqs) {
+        std::vector<std::uint8_t> lengths = timePhase(options.stats, Phase::codeLengths, [&]() {
+            return huffmanCodeLengths(freqs, options.maxCodeLength);
+        });
+        noteCodeLengths(options.stats, lengths);
+        // +PACKED_CODE_LENGTHS
+        packCodeLengths(body, lengths);
+        tables.push_back(EncodeTable(canonicalCodes(lengths)));
+        bits += codedBits(freqs, lengths);
+    }
+    if (body.size() + bits / 8.0 >= order0Bytes) {
+        body.clear();
+        return false;
+    }
+    PhaseTimer timer(options.stats, Phase::encode);
+    BitWriter bw(body);
+    encodeBytesWithContext(tables.data(), model.clusterOf, data, n, bw);
+    bw.finish();
+    return true;
+}
+
+/* Writes a BLOCK_LZ body for data to body, unless the parse found no
+matches. Returns whether it did. */
+static bool compressLzBlock(
+        const std::byte* data, const std::size_t n, const CscOptions& options,
+        std::vector<std::byte>& body) {
+    std::vector<LzToken> tokens = timePhase(options.stats, Phase::model, [&]() {
+        return lzParse(data, n, options.lzLevel);
+    });
+    if (tokens.size() == n)
+        return false;
+    std::vector<std::uint64_t> litlenFreqs(LZ_LITLEN_SYMBOLS, 0);
+    std::vector<std::uint64_t> distanceFreqs(LZ_DISTANCE_CODES, 0);
+    countLzSymbols(tokens, litlenFreqs, distanceFreqs);
+    // 257 or more literal and length symbols can't all fit in 8 bits
+    const unsigned maxLength = std::max(options.maxCodeLength, MIN_MAX_CODE_LENGTH + 1);
+    std::vector<std::uint8_t> litlenLengths, distanceLengths;
+    timePhase(options.stats, Phase::codeLengths, [&]() {
+        litlenLengths = huffmanCodeLengths(litlenFreqs, maxLength);
+        distanceLengths = huffmanCodeLengths(distanceFreqs, maxLength);
+    });
+    noteCodeLengths(options.stats, litlenLengths);
+    noteCodeLengths(options.stats, distanceLengths);
+    // +LITLEN_CODE_LENGTHS
+    packCodeLengths(body, litlenLengths);
+    // +DISTANCE_CODE_LENGTHS
+    packCodeLengths(body, distanceLengths);
+    EncodeTable litlen(canonicalCodes(litlenLengths), LZ_LITLEN_SYMBOLS);
+    EncodeTable distance(canonicalCodes(distanceLengths), LZ_DISTANCE_CODES);
+    PhaseTimer timer(options.stats, Phase::encode);
+    BitWriter bw(body);
+    encodeLzTokens(tokens, litlen, distance, bw);
+    bw.finish();
+    return true;
+}
+
+/* A code table chosen for a block before it's queued: fast levels pass one
+from block to block while keepTable says it still fits (see levels.hpp) */
+struct SharedTable {
+    std::vector<std::uint8_t> lengths;
+    EncodeTable table;
+};
+
+// What the submitting thread worked out about a block at a fast level
+struct BlockPlan {
+    std::vector<std::uint64_t> freqs;
+    std::shared_ptr<const SharedTable> table;
+};
+
+// A compressed frame and the number of original bytes it holds
+struct CodedFrame {
+    std::vector<std::byte> bytes;
+    std::uint64_t rawSize;
+};
+
+// Whether blocks written with options have their tables picked by planBlock
+static bool plansTables(const CscOptions& options) {
+    return options.level <= MAX_FAST_LEVEL && options.contextClusters == 0 && options.lzLevel == 0;
+}
+
+/* Counts a block at a fast level and picks its table: previous (the last
+block's), while keepTable allows, or else a new one that becomes previous.
+Run in block order on the submitting thread, so the output doesn't depend
+on which worker codes which block. */
+static BlockPlan planBlock(
+        const std::byte* data, const std::size_t n, const CscOptions& options,
+        std::shared_ptr<const SharedTable>& previous) {
+    BlockPlan plan;
+    plan.freqs = timePhase(options.stats, Phase::histogram, [&]() {
+        return levelHistogram(data, n, options);
+    });
+    if (previous == nullptr || !keepTable(plan.freqs, previous->lengths, options)) {
+        std::vector<std::uint8_t> lengths = timePhase(options.stats, Phase::codeLengths, [&]() {
+            return levelCodeLengths(plan.freqs, options);
+        });
+        noteCodeLengths(options.stats, lengths);
+        previous = std::make_shared<const SharedTable>(
+            SharedTable{lengths, EncodeTable(canonicalCodes(lengths))});
+    }
+    plan.table = previous;
+    return plan;
+}
+
+// The frame of compressBlock, without CHECKSUM, using plan's counts and table if it's given
+static std::vector<std::byte> encodeBlock(
+        const std::byte* data, const std::size_t n, const CscOptions& options,
+        const BlockPlan* plan) {
+    addStat(options.stats, &CscStats::blocks, 1);
+    std::vector<std::uint64_t> freqs = plan != nullptr ? plan->freqs
+        : timePhase(options.stats, Phase::histogram, [&]() {
+            return levelHistogram(data, n, options);
+        });
+    // repeats can make data LZ compressible even when its byte counts aren't
+    std::vector<std::byte> lzBody = std::vector<std::byte>();
+    if (options.lzLevel > 0 && n >= MIN_LZ_BLOCK_SIZE && n <= MAX_LZ_BLOCK_SIZE
+            && (!compressLzBlock(data, n, options, lzBody) || tooLittleGain(lzBody.size(), n)))
+        lzBody.clear();
+    auto storedOrLz = [&]() {
+        if (!lzBody.empty())
+            return genFrame(BLOCK_LZ, n, lzBody.data(), lzBody.size());
+        return genFrame(BLOCK_STORED, n, data, n);
+    };
+    if (tooLittleGain(entropyBits(freqs) / 8, n))
+        return storedOrLz();
+    std::shared_ptr<const SharedTable> shared = plan != nullptr ? plan->table : nullptr;
+    std::vector<std::uint8_t> lengths = shared != nullptr ? shared->lengths : std::vector<std::uint8_t>();
+    if (shared == nullptr) {
+        lengths = timePhase(options.stats, Phase::codeLengths, [&]() {
+            return levelCodeLengths(freqs, options);
+        });
+        noteCodeLengths(options.stats, lengths);
+    }
+    std::vector<std::byte> body = std::vector<std::byte>();
+    packCodeLengths(body, lengths);
+    const double order0Bytes = body.size() + codedBits(freqs, lengths) / 8.0;
+    if (tooLittleGain(order0Bytes, n))
+        return storedOrLz();
+    const bool lzWins = !lzBody.empty() && lzBody.size() < order0Bytes;
+    if (options.contextClusters > 0 && n >= MIN_CONTEXT_BLOCK_SIZE) {
+        std::vector<std::byte> contextBody = std::vector<std::byte>();
+        if (compressContextBlock(data, n, options,
+                lzWins ? lzBody.size() : order0Bytes, contextBody))
+            return genFrame(BLOCK_CONTEXT, n, contextBody.data(), contextBody.size());
+    }
+    if (lzWins)
+        return genFrame(BLOCK_LZ, n, lzBody.data(), lzBody.size());
+    PhaseTimer timer(options.stats, Phase::encode);
+    if (shared == nullptr)
+        shared = std::make_shared<const SharedTable>(
+            SharedTable{lengths, EncodeTable(canonicalCodes(lengths))});
+    const EncodeTable& table = shared->table;
+    // sampled counts only estimate the coded size, so check the real one
+    const bool estimated = sampledHistogram(n, options);
+    if (!options.interleave || n < MIN_INTERLEAVED_BLOCK_SIZE) {
+        BitWriter bw(body);
+        encodeBytes(table, data, n, bw);
+        bw.finish();
+        if (estimated && tooLittleGain((double) body.size(), n))
+            return storedOrLz();
+        return genFrame(BLOCK_HUFFMAN, n, body.data(), body.size());
+    }
+    const std::size_t part = (n + INTERLEAVED_STREAMS - 1) / INTERLEAVED_STREAMS;
+    std::vector<std::byte> streams = std::vector<std::byte>();
+    for (std::size_t s = 0; s < INTERLEAVED_STREAMS; s++) {
+        const std::size_t start = std::min(n, s * part);
+        const std::size_t before = streams.size();
+        BitWriter bw(streams);
+        encodeBytes(table, data + start, std::min(n, start + part) - start, bw);
+        bw.finish();
+        // +STREAM_SIZE
+        if (s + 1 < INTERLEAVED_STREAMS)
+            putVarint(body, streams.size() - before);
+    }
+    // +STREAMS
+    body.insert(body.end(), streams.begin(), streams.end());
+    if (estimated && tooLittleGain((double) body.size(), n))
+        return storedOrLz();
+    return genFrame(BLOCK_HUFFMAN4, n, body.data(), body.size());
+}
+
+// Appends the CHECKSUM of data, the n bytes frame holds, if options.checksums
+static std::vector<std::byte> finishFrame(
+        std::vector<std::byte> frame, const std::byte* data, const std::size_t n,
+        const CscOptions& options) {
+    if (options.checksums) {
+        // +CHECKSUM
+        putChecksum(frame, timePhase(options.stats, Phase::checksum, [&]() {
+            return crc32c(0, data, n);
+        }));
+    }
+    return frame;
+}
+
+std::vector<std::byte> compressBlock(
+        const std::byte* data, const std::size_t n, const CscOptions& options) {
+    return finishFrame(encodeBlock(data, n, options, nullptr), data, n, options);
+}
+
+// The frame of a part findSplits cut, coded with the counts it found
+static CodedFrame compressPart(const std::byte* data, SplitPart part, const CscOptions& options) {
+    const BlockPlan plan = {std::move(part.freqs), nullptr};
+    return {finishFrame(encodeBlock(data, part.n, options, &plan), data, part.n, options), part.n};
+}
+
+// The frames of one block of input: more than one where its distribution shifts
+static std::vector<CodedFrame> compressFrames(
+        const std::byte* data, const std::size_t n, const CscOptions& options,
+        const BlockPlan* plan) {
+    std::vector<CodedFrame> frames = std::vector<CodedFrame>();
+    if (!splitsBlocks(n, options)) {
+        frames.push_back({finishFrame(encodeBlock(data, n, options, plan), data, n, options), n});
+        return frames;
+    }
+    std::size_t start = 0;
+    for (SplitPart& part : findSplits(data, n, options.stats)) {
+        const std::byte* block = data + start;
+        start += part.n;
+        frames.push_back(compressPart(block, std::move(part), options));
+    }
+    return frames;
+}
+
+// Throws unless stored is the checksum of the n decoded bytes in data
+static void checkBlock(
+        const std::byte* data, const std::size_t n, const std::byte* stored, CscStats* stats) {
+    PhaseTimer timer(stats, Phase::checksum);
+    verifyChecksum(crc32c(0, data, n), loadChecksum(stored));
+}
+
+void checkBlockSize(
+        const std::uint8_t type, const std::byte* body, const std::size_t bodyLen,
+        const std::uint64_t rawSize) {
+    bool fits = rawSize <= MAX_BLOCK_SIZE;
+    if (type == BLOCK_STORED)
+        fits = rawSize == bodyLen;
+    if (fits && (type == BLOCK_HUFFMAN || type == BLOCK_HUFFMAN4)) {
+        ByteCursor cur(body, bodyLen);
+        std::vector<std::uint8_t> lengths = unpackCodeLengths(cur, 256);
+        // every byte of a multi-symbol code takes at least one bit
+        if (256 - std::count(lengths.begin(), lengths.end(), 0) > 1)
+            fits = rawSize / 8 <= bodyLen;
+    }
+    if (!fits)
+        throw std::runtime_error("Malformed block header in compressed data");
+}
+
+void decompressBlockBody(
+        const std::uint8_t type, const std::byte* body, const std::size_t bodyLen,
+        std::byte* out, const std::size_t rawSize) {
+    if (type == BLOCK_STORED) {
+        if (bodyLen != rawSize)
+            throw std::runtime_error("Malformed stored block in compressed data");
+        std::copy(body, body + bodyLen, out);
+        return;
+    }
+    if (type != BLOCK_HUFFMAN && type != BLOCK_HUFFMAN4 && type != BLOCK_CONTEXT && type != BLOCK_LZ)
+        throw std::runtime_error("Unknown block type " + std::to_string(type));
+    ByteCursor cur(body, bodyLen);
+    if (type == BLOCK_LZ) {
+        DecodeTable litlen(canonicalCodes(unpackCodeLengths(cur, LZ_LITLEN_SYMBOLS)));
+        DecodeTable distance(canonicalCodes(unpackCodeLengths(cur, LZ_DISTANCE_CODES)));
+        std::size_t bitsLen = cur.remaining();
+        BitReader br(cur.take(bitsLen), bitsLen);
+        decodeLzTokens(litlen, distance, br, out, rawSize);
+        if (br.overrun())
+            throw std::runtime_error("Compressed block is truncated");
+        return;
+    }
+    if (type == BLOCK_CONTEXT) {
+        unsigned numClusters = cur.next();
+        std::vector<std::uint8_t> clusterOf = unpackCodeLengths(cur, 256);
+        if (numClusters == 0 || numClusters > MAX_CONTEXT_CLUSTERS
+                || *std::max_element(clusterOf.begin(), clusterOf.end()) >= numClusters)
+            throw std::runtime_error("Malformed context map in compressed data");
+        std::vector<DecodeTable> tables = std::vector<DecodeTable>();
+        for (unsigned c = 0; c < numClusters; c++)
+            tables.push_back(DecodeTable(canonicalCodes(unpackCodeLengths(cur, 256))));
+        std::size_t bitsLen = cur.remaining();
+        BitReader br(cur.take(bitsLen), bitsLen);
+        decodeBytesWithContext(tables.data(), clusterOf.data(), br, out, rawSize);
+        if (br.overrun())
+            throw std::runtime_error("Compressed block is truncated");
+        return;
+    }
+    DecodeTable table(canonicalCodes(unpackCodeLengths(cur, 256)));
+    if (type == BLOCK_HUFFMAN4) {
+        std::size_t streamSizes[INTERLEAVED_STREAMS];
+        for (std::size_t s = 0; s + 1 < INTERLEAVED_STREAMS; s++)
+            streamSizes[s] = (std::size_t) std::min<std::uint64_t>(readVarint(cur), bodyLen);
+        const std::byte* streams[INTERLEAVED_STREAMS];
+        std::byte* outs[INTERLEAVED_STREAMS];
+        std::size_t sizes[INTERLEAVED_STREAMS];
+        const std::size_t part = (rawSize + INTERLEAVED_STREAMS - 1) / INTERLEAVED_STREAMS;
+        for (std::size_t s = 0; s < INTERLEAVED_STREAMS; s++) {
+            if (s + 1 == INTERLEAVED_STREAMS)
+                streamSizes[s] = cur.remaining();
+            streams[s] = cur.take(streamSizes[s]);
+            const std::size_t start = std::min(rawSize, s * part);
+            outs[s] = out + start;
+            sizes[s] = std::min(rawSize, start + part) - start;
+        }
+        decodeInterleaved(table, streams, streamSizes, outs, sizes);
+        return;
+    }
+    std::size_t bitsLen = cur.remaining();
+    BitReader br(cur.take(bitsLen), bitsLen);
+    decodeBytes(table, br, out, rawSize);
+    if (br.overrun())
+        throw std::runtime_error("Compressed block is truncated");
+}
+
+ThreadPool& poolFor(const CscOptions& options, std::unique_ptr<ThreadPool>& ownPool) {
+    if (options.pool != nullptr)
+        return *options.pool;
+    ownPool = std::make_unique<ThreadPool>(options.threads);
+    return *ownPool;
+}
+
+// a blockSize of 0 only means "don't split" to callers choosing a format
+static std::size_t splitSize(const CscOptions& options) {
+    return options.blockSize > 0 ? std::min(options.blockSize, MAX_BLOCK_SIZE) : DEFAULT_BLOCK_SIZE;
+}
+
+/* Shared by all writeBlocks versions: submitBlock(n, got) takes up to n
+bytes of input, sets got to how many it took and, if that isn't 0, returns
+the future of their compressed frames from pool. Frames are written in
+order; with a streamed input they go through a writer thread, so writing
+one overlaps with coding the next, while input already in memory (and so
+most often output to memory too) is written directly. */
+template <class SubmitBlock>
+static std::uint64_t writeBlocksWith(
+        SubmitBlock submitBlock, ThreadPool& pool, const bool streamed, std::ostream& wf,
+        const std::uint64_t payloadOffset, const std::uint64_t n_total_chars,
+        const CscOptions& options) {
+    // bounds how much input is held in memory at once
+    const std::size_t maxPending = 2 * pool.size();
+    std::deque<std::future<std::vector<CodedFrame>>> pending;
+    std::vector<std::byte> index = std::vector<std::byte>();
+    std::uint64_t numBlocks = 0;
+    std::uint64_t offset = payloadOffset;
+    AsyncWriter writer(wf, options.stats, streamed && threadsStreams(options));
+    auto writeOldest = [&]() {
+        for (CodedFrame& frame : pool.wait(pending.front())) {
+            putVarint(index, frame.bytes.size());
+            putVarint(index, frame.rawSize);
+            offset += frame.bytes.size();
+            numBlocks++;
+            writer.write(std::move(frame.bytes));
+        }
+        pending.pop_front();
+    };
+    std::uint64_t total = 0;
+    const std::size_t blockSize = splitSize(options);
+    try {
+        for (std::uint64_t remaining = n_total_chars; remaining > 0;) {
+            std::size_t n = (std::size_t) std::min<std::uint64_t>(blockSize, remaining);
+            std::size_t got = 0;
+            auto frame = submitBlock(n, got);
+            if (got == 0)
+                break;
+            pending.push_back(std::move(frame));
+            total += got;
+            if (n_total_chars != UNKNOWN_LENGTH)
+                remaining -= got;
+            if (pending.size() >= maxPending)
+                writeOldest();
+        }
+        while (!pending.empty())
+            writeOldest();
+    } catch (...) {
+        // queued blocks may point into the caller's input
+        for (auto& frame : pending) {
+            try {
+                pool.wait(frame);
+            } catch (...) {}
+        }
+        throw;
+    }
+    std::vector<std::byte> trailer = std::vector<std::byte>();
+    // +END_MARKER
+    trailer.push_back((std::byte) BLOCK_END);
+    // +NUM_BLOCKS
+    putVarint(trailer, numBlocks);
+    // +FRAME_SIZE, RAW_SIZE pairs
+    trailer.insert(trailer.end(), index.begin(), index.end());
+    // +INDEX_OFFSET
+    putLittleEndian64(trailer, offset + 1);
+    const std::size_t trailerSize = trailer.size();
+    writer.write(std::move(trailer));
+    writer.finish();
+    addStat(options.stats, &CscStats::bytesIn, total);
+    addStat(options.stats, &CscStats::bytesOut, offset - payloadOffset + trailerSize);
+    return total;
+}
+
+std::uint64_t writeBlocks(
+        std::istream& rf, std::ostream& wf, const std::uint64_t payloadOffset,
+        const std::uint64_t n_total_chars, const CscOptions& options) {
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool& pool = poolFor(options, ownPool);
+    std::shared_ptr<const SharedTable> previous;
+    // the reader thread reads ahead in the same blocks writeBlocksWith asks for
+    AsyncReader reader(
+        rf, splitSize(options), n_total_chars, options.stats, threadsStreams(options));
+    auto submitBlock = [&](const std::size_t n, std::size_t& got) {
+        std::vector<std::byte> data = std::vector<std::byte>();
+        if (!reader.next(data))
+            data.clear();
+        got = data.size();
+        if (got != n && n_total_chars != UNKNOWN_LENGTH)
+            throw std::runtime_error("Input ended early while compressing");
+        if (got == 0)
+            return std::future<std::vector<CodedFrame>>();
+        std::optional<BlockPlan> plan;
+        if (plansTables(options))
+            plan = planBlock(data.data(), got, options, previous);
+        return pool.submit([data = std::move(data), plan = std::move(plan), &options]() {
+            return compressFrames(data.data(), data.size(), options, plan ? &*plan : nullptr);
+        });
+    };
+    return writeBlocksWith(submitBlock, pool, true, wf, payloadOffset, n_total_chars, options);
+}
+
+void writeBlocks(
+        const std::byte* data, std::ostream& wf, const std::uint64_t payloadOffset,
+        const std::uint64_t n_total_chars, const CscOptions& options) {
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool& pool = poolFor(options, ownPool);
+    std::shared_ptr<const SharedTable> previous;
+    std::uint64_t next = 0;
+    auto submitBlock = [&](const std::size_t n, std::size_t& got) {
+        const std::byte* block = data + next;
+        next += n;
+        got = n;
+        std::optional<BlockPlan> plan;
+        if (plansTables(options))
+            plan = planBlock(block, n, options, previous);
+        return pool.submit([block, n, plan = std::move(plan), &options]() {
+            return compressFrames(block, n, options, plan ? &*plan : nullptr);
+        });
+    };
+    writeBlocksWith(submitBlock, pool, false, wf, payloadOffset, n_total_chars, options);
+}
+
+void writeBlocks(
+        const std::byte* data, std::ostream& wf, const std::uint64_t payloadOffset,
+        const std::vector<SplitPart>& parts, const CscOptions& options) {
+    std::uint64_t n_total_chars = 0;
+    for (const SplitPart& part : parts)
+        n_total_chars += part.n;
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool& pool = poolFor(options, ownPool);
+    std::size_t nextPart = 0;
+    std::uint64_t next = 0;
+    auto submitBlock = [&](const std::size_t, std::size_t& got) {
+        const SplitPart& part = parts[nextPart++];
+        const std::byte* block = data + next;
+        next += part.n;
+        got = part.n;
+        return pool.submit([block, &part, &options]() {
+            return std::vector<CodedFrame>({compressPart(block, part, options)});
+        });
+    };
+    writeBlocksWith(submitBlock, pool, false, wf, payloadOffset, n_total_chars, options);
+}
+
+std::uint64_t readBlocks(
+        std::istream& rf, std::ostream& wf, const CscHeader& header, const CscOptions& options) {
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool& pool = poolFor(options, ownPool);
+    // bounds how many blocks are held in memory at once
+    const std::size_t maxPending = 2 * pool.size();
+    std::deque<std::future<std::vector<std::byte>>> pending;
+    AsyncWriter writer(wf, options.stats, threadsStreams(options));
+    auto writeOldest = [&]() {
+        writer.write(pool.wait(pending.front()));
+        pending.pop_front();
+    };
+    const bool checksummed = (header.flags & CSC_FLAG_CHECKSUM) != 0;
+    const bool sized = !(header.flags & CSC_FLAG_STREAM);
+    std::uint64_t written = 0;
+    bool ended = false;
+    try {
+        for (char b; rf.get(b);) {
+            if ((std::uint8_t) b == BLOCK_END) {
+                ended = true;
+                break;
+            }
+            std::uint8_t type = (std::uint8_t) b;
+            std::uint64_t rawSize = readVarint(rf);
+            std::uint64_t bodyLen = readVarint(rf);
+            // a coded byte takes at most MAX_MAX_CODE_LENGTH bits, plus the code table
+            if ((sized && rawSize > header.originalLen - written) || rawSize > MAX_BLOCK_SIZE
+                    || bodyLen > 4 * rawSize + 1024)
+                throw std::runtime_error("Malformed block header in compressed data");
+            // the body and its checksum, read together
+            std::vector<std::byte> frame(bodyLen + (checksummed ? CHECKSUM_SIZE : 0));
+            timePhase(options.stats, Phase::io, [&]() {
+                rf.read(reinterpret_cast<char*>(frame.data()), frame.size());
+            });
+            if ((std::uint64_t) rf.gcount() != frame.size())
+                throw std::runtime_error("Compressed data is truncated");
+            checkBlockSize(type, frame.data(), bodyLen, rawSize);
+            CscStats* stats = options.stats;
+            auto decode = [frame = std::move(frame), type, bodyLen, rawSize, checksummed, stats]() {
+                std::vector<std::byte> out(rawSize);
+                timePhase(stats, Phase::decode, [&]() {
+                    decompressBlockBody(type, frame.data(), bodyLen, out.data(), rawSize);
+                });
+                if (checksummed)
+                    checkBlock(out.data(), rawSize, frame.data() + bodyLen, stats);
+                addStat(stats, &CscStats::blocks, 1);
+                return out;
+            };
+            pending.push_back(pool.submit(std::move(decode)));
+            written += rawSize;
+            if (pending.size() >= maxPending)
+                writeOldest();
+        }
+        if (!ended || (sized && written != header.originalLen))
+            throw std::runtime_error("Compressed data is truncated");
+        while (!pending.empty())
+            writeOldest();
+    } catch (...) {
+        for (auto& block : pending) {
+            try {
+                pool.wait(block);
+            } catch (...) {}
+        }
+        throw;
+    }
+    writer.finish();
+    return written;
+}
+
+std::vector<BlockInfo> readBlockIndex(
+        PositionedFile& in, const CscHeader& header, const std::uint64_t payloadOffset) {
+    const std::uint64_t fileSize = in.size();
+    if (fileSize < payloadOffset + 1 + BLOCK_INDEX_OFFSET_SIZE)
+        throw std::runtime_error("Compressed data is truncated");
+    std::byte offsetBytes[BLOCK_INDEX_OFFSET_SIZE];
+    in.readAt(fileSize - BLOCK_INDEX_OFFSET_SIZE, offsetBytes, BLOCK_INDEX_OFFSET_SIZE);
+    std::uint64_t indexOffset = 0;
+    for (std::size_t i = 0; i < BLOCK_INDEX_OFFSET_SIZE; i++)
+        indexOffset |= (std::uint64_t) offsetBytes[i] << (i * 8);
+    if (indexOffset <= payloadOffset || indexOffset > fileSize - BLOCK_INDEX_OFFSET_SIZE)
+        throw std::runtime_error("Malformed block index in compressed data");
+    std::vector<std::byte> indexBytes(fileSize - BLOCK_INDEX_OFFSET_SIZE - indexOffset);
+    in.readAt(indexOffset, indexBytes.data(), indexBytes.size());
+    ByteCursor cur(indexBytes.data(), indexBytes.size());
+    std::uint64_t numBlocks = readVarint(cur);
+    const bool sized = !(header.flags & CSC_FLAG_STREAM);
+    if (numBlocks > indexBytes.size() / 2)
+        throw std::runtime_error("Malformed block index in compressed data");
+    std::vector<BlockInfo> blocks = std::vector<BlockInfo>();
+    blocks.reserve(numBlocks);
+    std::uint64_t frameOffset = payloadOffset;
+    std::uint64_t rawOffset = 0;
+    for (std::uint64_t i = 0; i < numBlocks; i++) {
+        BlockInfo info = {frameOffset, readVarint(cur), rawOffset, readVarint(cur),
+                          (header.flags & CSC_FLAG_CHECKSUM) != 0};
+        frameOffset += info.frameSize;
+        rawOffset += info.rawSize;
+        if (frameOffset >= indexOffset || info.rawSize > MAX_BLOCK_SIZE
+                || (sized && rawOffset > header.originalLen))
+            throw std::runtime_error("Malformed block index in compressed data");
+        blocks.push_back(info);
+    }
+    // the frames must exactly fill the space up to the end marker
+    if (frameOffset + 1 != indexOffset || (sized && rawOffset != header.originalLen))
+        throw std::runtime_error("Malformed block index in compressed data");
+    return blocks;
+}
+
+std::vector<std::byte> decodeBlock(PositionedFile& in, const BlockInfo& info, CscStats* stats) {
+    std::vector<std::byte> frame(info.frameSize);
+    timePhase(stats, Phase::io, [&]() {
+        in.readAt(info.frameOffset, frame.data(), frame.size());
+    });
+    ByteCursor cur(frame.data(), frame.size());
+    std::uint8_t type = cur.next();
+    std::uint64_t rawSize = readVarint(cur);
+    std::uint64_t bodyLen = readVarint(cur);
+    const std::size_t checksumSize = info.checksummed ? CHECKSUM_SIZE : 0;
+    if (rawSize != info.rawSize || bodyLen + checksumSize != cur.remaining())
+        throw std::runtime_error("Block header doesn't match the block index");
+    const std::byte* body = cur.take(bodyLen);
+    checkBlockSize(type, body, bodyLen, rawSize);
+    std::vector<std::byte> raw(rawSize);
+    timePhase(stats, Phase::decode, [&]() {
+        decompressBlockBody(type, body, bodyLen, raw.data(), rawSize);
+    });
+    if (info.checksummed)
+        checkBlock(raw.data(), rawSize, cur.take(CHECKSUM_SIZE), stats);
+    addStat(stats, &CscStats::blocks, 1);
+    return raw;
+}
+
+static void decodeBlockAt(
+        PositionedFile& in, const BlockInfo& info, PositionedFile& out,
+        const std::uint64_t rangeStart, const std::uint64_t rangeEnd, CscStats* stats) {
+    std::vector<std::byte> raw = decodeBlock(in, info, stats);
+    std::uint64_t from = std::max(rangeStart, info.rawOffset);
+    std::uint64_t to = std::min(rangeEnd, info.rawOffset + info.rawSize);
+    PhaseTimer timer(stats, Phase::io);
+    out.writeAt(from - rangeStart, raw.data() + (from - info.rawOffset), to - from);
+}
+
+void decodeBlocksParallel(
+        PositionedFile& in, const std::vector<BlockInfo>& blocks,
+        const std::string& outputFile, const std::uint64_t rangeStart,
+        const std::uint64_t rangeEnd, const CscOptions& options) {
+    PositionedFile out(outputFile, true);
+    out.resize(rangeEnd - rangeStart);
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool& pool = poolFor(options, ownPool);
+    std::vector<std::future<void>> results = std::vector<std::future<void>>();
+    for (const BlockInfo& info : blocks) {
+        if (info.rawOffset + info.rawSize <= rangeStart || info.rawOffset >= rangeEnd)
+            continue;
+        CscStats* stats = options.stats;
+        results.push_back(pool.submit([&in, &info, &out, rangeStart, rangeEnd, stats]() {
+            decodeBlockAt(in, info, out, rangeStart, rangeEnd, stats);
+        }));
+    }
+    // the tasks use in and out, so all of them must finish before returning
+    pool.waitAll(results);
+}
+
+void testBlocks(PositionedFile& in, const std::vector<BlockInfo>& blocks, const CscOptions& options) {
+    std::unique_ptr<ThreadPool> ownPool;
+    ThreadPool& pool = poolFor(options, ownPool);
+    std::vector<std::future<void>> results = std::vector<std::future<void>>();
+    CscStats* stats = options.stats;
+    for (const BlockInfo& info : blocks) {
+        results.push_back(pool.submit([&in, &info, stats]() {
+            decodeBlock(in, info, stats);
+        }));
+    }
+    // the tasks use in, so all of them must finish before returning
+    pool.waitAll(results);
+}
@@ -0,0 +1,177 @@
+#include <checksum.hpp>
+#include <cstring>
+#include <stdexcept>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #include <nmmintrin.h>
+    #define CSC_HAVE_CRC32_SSE42 1
+#endif
+
+constexpr std::uint32_t CRC32C_POLY = 0x82F63B78; // reflected
+
+// the hardware path runs three streams of this many bytes side by side
+constexpr std::size_t CRC_LONG = 8192;
+constexpr std::size_t CRC_SHORT = 256;
+
+// Multiplies the 32x32 GF(2) matrix mat by vec
+static std::uint32_t gf2MatrixTimes(const std::uint32_t* mat, std::uint32_t vec) {
+    std::uint32_t sum = 0;
+    for (; vec != 0; vec >>= 1, mat++) {
+        if (vec & 1)
+            sum ^= *mat;
+    }
+    return sum;
+}
+
+static void gf2MatrixSquare(std::uint32_t* square, const std::uint32_t* mat) {
+    for (unsigned n = 0; n < 32; n++)
+        square[n] = gf2MatrixTimes(mat, mat[n]);
+}
+
+/* The operator that appends len zero bytes (a power of two) to a CRC,
+as four byte-indexed tables so applying it takes four lookups. */
+struct ZerosTable {
+    std::uint32_t t[4][256];
+
+    explicit ZerosTable(std::size_t len) {
+        std::uint32_t even[32], odd[32];
+        // odd: the operator for one zero bit
+        odd[0] = CRC32C_POLY;
+        for (unsigned n = 1; n < 32; n++)
+            odd[n] = 1U << (n - 1);
+        gf2MatrixSquare(even, odd); // two zero bits
+        gf2MatrixSquare(odd, even); // four zero bits
+        // square up to one zero byte, then once more per halving of len
+        const std::uint32_t* op = odd;
+        for (;;) {
+            gf2MatrixSquare(even, odd);
+            op = even;
+            len >>= 1;
+            if (len == 0)
+                break;
+            gf2MatrixSquare(odd, even);
+            op = odd;
+            len >>= 1;
+            if (len == 0)
+                break;
+        }
+        for (unsigned n = 0; n < 256; n++) {
+            t[0][n] = gf2MatrixTimes(op, n);
+            t[1][n] = gf2MatrixTimes(op, n << 8);
+            t[2][n] = gf2MatrixTimes(op, n << 16);
+            t[3][n] = gf2MatrixTimes(op, n << 24);
+        }
+    }
+
+    std::uint32_t shift(const std::uint32_t crc) const {
+        return t[0][crc & 0xFF] ^ t[1][(crc >> 8) & 0xFF]
+            ^ t[2][(crc >> 16) & 0xFF] ^ t[3][crc >> 24];
+    }
+};
+
+struct SliceTables {
+    std::uint32_t t[8][256];
+
+    SliceTables() {
+        for (unsigned n = 0; n < 256; n++) {
+            std::uint32_t crc = n;
+            for (unsigned k = 0; k < 8; k++)
+                crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+            t[0][n] = crc;
+        }
+        for (unsigned n = 0; n < 256; n++) {
+            for (unsigned k = 1; k < 8; k++)
+                t[k][n] = (t[k - 1][n] >> 8) ^ t[0][t[k - 1][n] & 0xFF];
+        }
+    }
+};
+
+std::uint32_t crc32cSoftware(std::uint32_t crc, const std::byte* data, std::size_t n) {
+    static const SliceTables tables;
+    const auto& t = tables.t;
+    crc = ~crc;
+    for (; n >= 8; n -= 8, data += 8) {
+        // the tables are indexed little-endian, whatever the host order
+        const auto* b = reinterpret_cast<const unsigned char*>(data);
+        std::uint32_t lo = (std::uint32_t) b[0] | (std::uint32_t) b[1] << 8
+            | (std::uint32_t) b[2] << 16 | (std::uint32_t) b[3] << 24;
+        std::uint32_t hi = (std::uint32_t) b[4] | (std::uint32_t) b[5] << 8
+            | (std::uint32_t) b[6] << 16 | (std::uint32_t) b[7] << 24;
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    for (; n > 0; n--, data++)
+        crc = (crc >> 8) ^ t[0][(crc ^ (unsigned char) *data) & 0xFF];
+    return ~crc;
+}
+
+#if defined(CSC_HAVE_CRC32_SSE42)
+static inline std::uint64_t load64(const std::byte* p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+/* The crc32 instruction has a latency of three cycles but can start one
+per cycle, so runs of 3 * len bytes are split into three streams coded at
+once, then joined by shifting each CRC over the len bytes after it. */
+__attribute__((target("sse4.2")))
+static void crc32cThreeStreams(
+        std::uint64_t& crc0, const std::byte*& data, std::size_t& n,
+        const std::size_t len, const ZerosTable& shift) {
+    while (n >= 3 * len) {
+        std::uint64_t crc1 = 0, crc2 = 0;
+        for (const std::byte* end = data + len; data < end; data += 8) {
+            crc0 = _mm_crc32_u64(crc0, load64(data));
+            crc1 = _mm_crc32_u64(crc1, load64(data + len));
+            crc2 = _mm_crc32_u64(crc2, load64(data + 2 * len));
+        }
+        crc0 = shift.shift((std::uint32_t) crc0) ^ crc1;
+        crc0 = shift.shift((std::uint32_t) crc0) ^ crc2;
+        data += 2 * len;
+        n -= 3 * len;
+    }
+}
+
+__attribute__((target("sse4.2")))
+static std::uint32_t crc32cHardware(std::uint32_t crc, const std::byte* data, std::size_t n) {
+    static const ZerosTable longShift(CRC_LONG);
+    static const ZerosTable shortShift(CRC_SHORT);
+    std::uint64_t crc0 = ~crc;
+    for (; n > 0 && ((std::uintptr_t) data & 7) != 0; n--, data++)
+        crc0 = _mm_crc32_u8((std::uint32_t) crc0, (std::uint8_t) *data);
+    crc32cThreeStreams(crc0, data, n, CRC_LONG, longShift);
+    crc32cThreeStreams(crc0, data, n, CRC_SHORT, shortShift);
+    for (; n >= 8; n -= 8, data += 8)
+        crc0 = _mm_crc32_u64(crc0, load64(data));
+    for (; n > 0; n--, data++)
+        crc0 = _mm_crc32_u8((std::uint32_t) crc0, (std::uint8_t) *data);
+    return ~(std::uint32_t) crc0;
+}
+#endif
+
+std::uint32_t crc32c(std::uint32_t crc, const std::byte* data, std::size_t n) {
+#if defined(CSC_HAVE_CRC32_SSE42)
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware)
+        return crc32cHardware(crc, data, n);
+#endif
+    return crc32cSoftware(crc, data, n);
+}
+
+void putChecksum(std::vector<std::byte>& out, const std::uint32_t crc) {
+    for (std::size_t i = 0; i < CHECKSUM_SIZE; i++)
+        out.push_back((std::byte) (crc >> (i * 8)));
+}
+
+std::uint32_t loadChecksum(const std::byte* p) {
+    std::uint32_t crc = 0;
+    for (std::size_t i = 0; i < CHECKSUM_SIZE; i++)
+        crc |= (std::uint32_t) p[i] << (i * 8);
+    return crc;
+}
+
+void verifyChecksum(const std::uint32_t actual, const std::uint32_t expected) {
+    if (actual != expected)
+        throw std::runtime_error("Checksum mismatch: the compressed data is corrupt");
+}
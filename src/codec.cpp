@@ -0,0 +1,300 @@
+#include <codec.hpp>
+#include <blocks.hpp>
+#include <histogram.hpp>
+#include <threadpool.hpp>
+#include <checksum.hpp>
+#include <dictionary.hpp>
+#include <split.hpp>
+#include <levels.hpp>
+#include <stats.hpp>
+#include <algorithm>
+
+// Output stream that appends to a vector
+class VectorStreamBuf : public std::streambuf {
+    public:
+        explicit VectorStreamBuf(std::vector<std::byte>& target) : target(target) {}
+
+    protected:
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            const std::byte* bytes = reinterpret_cast<const std::byte*>(s);
+            target.insert(target.end(), bytes, bytes + n);
+            return n;
+        }
+
+        int_type overflow(int_type c) override {
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+                target.push_back((std::byte) traits_type::to_char_type(c));
+            return traits_type::not_eof(c);
+        }
+
+    private:
+        std::vector<std::byte>& target;
+};
+
+// Input stream over bytes in memory, seekable so tellg() works
+class MemoryStreamBuf : public std::streambuf {
+    public:
+        MemoryStreamBuf(const std::byte* data, const std::size_t n) {
+            char* start = const_cast<char*>(reinterpret_cast<const char*>(data));
+            setg(start, start, start + n);
+        }
+
+    protected:
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                         std::ios_base::openmode which) override {
+            if (!(which & std::ios_base::in))
+                return pos_type(off_type(-1));
+            char* base = (dir == std::ios_base::beg) ? eback()
+                       : (dir == std::ios_base::cur) ? gptr() : egptr();
+            if (off < eback() - base || off > egptr() - base)
+                return pos_type(off_type(-1));
+            setg(eback(), base + off, egptr());
+            return pos_type(gptr() - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+};
+
+SingleStreamCode chooseSingleStreamCode(
+        const std::byte* data, const std::size_t n, const std::string& ext,
+        const std::optional<std::uint32_t> checksum, const CscOptions& options,
+        const std::vector<std::uint64_t>* counted, const std::vector<std::uint8_t>& lastLengths) {
+    SingleStreamCode code;
+    const CscDictionary* dictionary = options.dictionary;
+    if (dictionary != nullptr && options.dictionaryTable != BEST_DICTIONARY_TABLE) {
+        // with the table named there's nothing to count, so the data is read once
+        code.dictionaryTable = &dictionaryEncodeTable(*dictionary, options.dictionaryTable);
+        code.header = genDictionaryHeaderBytes(
+            ext, n, dictionary->id, (std::uint8_t) options.dictionaryTable, checksum);
+        code.estimated = true;
+        return code;
+    }
+    const std::vector<std::uint64_t> freqs = counted != nullptr ? *counted
+        : timePhase(options.stats, Phase::histogram, [&]() { return levelHistogram(data, n, options); });
+    code.estimated = counted == nullptr && sampledHistogram(n, options);
+    if (!tooLittleGain(entropyBits(freqs) / 8, n)) {
+        if (keepTable(freqs, lastLengths, options)) {
+            // a fast level codes with the last payload's table while it still fits
+            code.lengths = lastLengths;
+        } else {
+            code.lengths = timePhase(options.stats, Phase::codeLengths, [&]() {
+                return levelCodeLengths(freqs, options);
+            });
+            noteCodeLengths(options.stats, code.lengths);
+        }
+        code.header = timePhase(options.stats, Phase::header, [&]() {
+            return genHeaderBytesV2(ext, n, code.lengths, checksum);
+        });
+    }
+    // a dictionary table, where it beats storing the payload's own table
+    if (dictionary != nullptr) {
+        std::uint64_t bits;
+        const unsigned t = bestDictionaryTable(*dictionary, freqs, bits);
+        std::vector<std::byte> dictionaryHeader = genDictionaryHeaderBytes(
+            ext, n, dictionary->id, (std::uint8_t) t, checksum);
+        if (code.header.empty() || dictionaryHeader.size() * 8 + bits
+                < code.header.size() * 8 + codedBits(freqs, code.lengths)) {
+            code.header = std::move(dictionaryHeader);
+            code.lengths = dictionary->lengths[t];
+            code.dictionaryTable = &dictionary->encodeTables[t];
+        }
+    }
+    code.stored = code.header.empty()
+        || tooLittleGain(code.header.size() + codedBits(freqs, code.lengths) / 8.0, n);
+    return code;
+}
+
+bool encodeSingleStream(
+        const std::byte* data, const std::size_t n, const SingleStreamCode& code,
+        const EncodeTable& table, std::vector<std::byte>& out, CscStats* stats) {
+    const std::size_t start = out.size();
+    out.insert(out.end(), code.header.begin(), code.header.end());
+    timePhase(stats, Phase::encode, [&]() {
+        BitWriter bw(out);
+        encodeBytes(table, data, n, bw);
+        bw.finish();
+    });
+    // an estimated code only guesses the coded size, so check the real one
+    if (code.estimated && tooLittleGain((double) (out.size() - start), n)) {
+        out.resize(start);
+        return false;
+    }
+    return true;
+}
+
+Encoder::Encoder(const CscOptions& options) :
+    options(levelOptions(options)) {}
+
+Encoder::~Encoder() = default;
+
+ThreadPool& Encoder::blockPool() {
+    if (options.pool != nullptr)
+        return *options.pool;
+    if (!ownPool)
+        ownPool = std::make_unique<ThreadPool>(options.threads);
+    return *ownPool;
+}
+
+void Encoder::compress(const std::byte* data, const std::size_t n, std::vector<std::byte>& out) {
+    out.clear();
+    // blocks also suit content whose distribution shifts partway: it codes smaller with a table per part
+    const bool blocks = needsBlocks(options) || (options.blockSize > 0 && n > options.blockSize);
+    std::vector<SplitPart> parts = std::vector<SplitPart>();
+    if (!blocks && options.dictionary == nullptr && splitsBlocks(n, options))
+        parts = findSplits(data, n, options.stats);
+    if (blocks || parts.size() > 1) {
+        std::vector<std::byte> header = genBlockedHeaderBytes("", n, checksumFlag(options));
+        out.insert(out.end(), header.begin(), header.end());
+        VectorStreamBuf sink(out);
+        std::ostream wf(&sink);
+        CscOptions blockOptions = options;
+        blockOptions.pool = &blockPool();
+        if (blocks)
+            writeBlocks(data, wf, header.size(), n, blockOptions);
+        else
+            writeBlocks(data, wf, header.size(), parts, blockOptions);
+        return;
+    }
+    std::optional<std::uint32_t> checksum;
+    if (options.checksums)
+        checksum = crc32c(0, data, n);
+    const SingleStreamCode code = chooseSingleStreamCode(
+        data, n, "", checksum, options, parts.empty() ? nullptr : &parts[0].freqs, tableLengths);
+    if (!code.stored) {
+        const EncodeTable* coder = code.dictionaryTable;
+        if (coder == nullptr) {
+            if (code.lengths != tableLengths) {
+                table = EncodeTable(canonicalCodes(code.lengths));
+                tableLengths = code.lengths;
+            }
+            coder = &table;
+        }
+        if (encodeSingleStream(data, n, code, *coder, out, options.stats))
+            return;
+    }
+    std::vector<std::byte> stored = genStoredHeaderBytes("", n, checksum);
+    out.insert(out.end(), stored.begin(), stored.end());
+    out.insert(out.end(), data, data + n);
+}
+
+Decoder::Decoder(const CscOptions& options) : options(options) {}
+
+Decoder::~Decoder() = default;
+
+ThreadPool& Decoder::blockPool() {
+    if (options.pool != nullptr)
+        return *options.pool;
+    if (!ownPool)
+        ownPool = std::make_unique<ThreadPool>(options.threads);
+    return *ownPool;
+}
+
+static bool sameCodes(const std::vector<HuffCode>& a, const std::vector<HuffCode>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+        [](const HuffCode& x, const HuffCode& y) {
+            return x.bits == y.bits && x.length == y.length && x.symbol == y.symbol;
+        });
+}
+
+// A frame of a blocked payload, located by scanning the frame headers
+struct MemoryBlock {
+    std::uint8_t type;
+    const std::byte* body;
+    std::size_t bodyLen;
+    std::uint64_t rawOffset;
+    std::uint64_t rawSize;
+    const std::byte* checksum; // nullptr without CSC_FLAG_CHECKSUM
+};
+
+static void decodeMemoryBlock(const MemoryBlock& block, std::byte* dest) {
+    decompressBlockBody(block.type, block.body, block.bodyLen, dest, block.rawSize);
+    if (block.checksum != nullptr)
+        verifyChecksum(crc32c(0, dest, block.rawSize), loadChecksum(block.checksum));
+}
+
+void Decoder::decompress(const std::byte* data, const std::size_t n, std::vector<std::byte>& out) {
+    MemoryStreamBuf source(data, n);
+    std::istream rf(&source);
+    CscHeader header = readHeader(rf);
+    useDictionary(header, options.dictionary);
+    if (header.flags & CSC_FLAG_ARCHIVE)
+        throw std::invalid_argument("Archives can't be decompressed in memory");
+    const std::size_t payloadOffset = (std::size_t) rf.tellg();
+    ByteCursor cur(data + payloadOffset, n - payloadOffset);
+    if (header.flags & CSC_FLAG_STORED) {
+        const std::byte* original = cur.take(header.originalLen);
+        out.assign(original, original + header.originalLen);
+        if (header.flags & CSC_FLAG_CHECKSUM)
+            verifyChecksum(crc32c(0, out.data(), out.size()), header.checksum);
+        return;
+    }
+    if (!(header.flags & CSC_FLAG_BLOCKS)) {
+        if (!table || !sameCodes(header.codes, tableCodes)) {
+            table = std::make_unique<DecodeTable>(header.codes);
+            tableCodes = header.codes;
+        }
+        // every symbol of a multi-symbol code takes at least one bit
+        if (!table->singleSymbol && header.originalLen / 8 > cur.remaining())
+            throw std::runtime_error("Compressed data is truncated");
+        out.resize(header.originalLen);
+        BitReader br(data + payloadOffset, n - payloadOffset);
+        decodeBytes(*table, br, out.data(), out.size());
+        if (br.overrun())
+            throw std::runtime_error("Compressed data is truncated");
+        if (header.flags & CSC_FLAG_CHECKSUM)
+            verifyChecksum(crc32c(0, out.data(), out.size()), header.checksum);
+        return;
+    }
+    std::vector<MemoryBlock> blocks = std::vector<MemoryBlock>();
+    const bool sized = !(header.flags & CSC_FLAG_STREAM);
+    std::uint64_t total = 0;
+    for (std::uint8_t type = cur.next(); type != BLOCK_END; type = cur.next()) {
+        std::uint64_t rawSize = readVarint(cur);
+        std::uint64_t bodyLen = readVarint(cur);
+        // a coded byte takes at most MAX_MAX_CODE_LENGTH bits, plus the code table
+        if ((sized && rawSize > header.originalLen - total) || bodyLen > 4 * rawSize + 1024
+                || bodyLen > cur.remaining())
+            throw std::runtime_error("Malformed block header in compressed data");
+        const std::byte* body = cur.take(bodyLen);
+        checkBlockSize(type, body, bodyLen, rawSize);
+        const std::byte* checksum = (header.flags & CSC_FLAG_CHECKSUM) ? cur.take(CHECKSUM_SIZE) : nullptr;
+        blocks.push_back({type, body, (std::size_t) bodyLen, total, rawSize, checksum});
+        total += rawSize;
+    }
+    if (sized && total != header.originalLen)
+        throw std::runtime_error("Compressed data is truncated");
+    // checked blocks are no larger than their bodies can hold, so neither is their total
+    if (total > (std::uint64_t) n * MAX_BLOCK_SIZE)
+        throw std::runtime_error("Malformed block header in compressed data");
+    out.resize(total);
+    if (blocks.size() == 1) {
+        decodeMemoryBlock(blocks[0], out.data());
+        return;
+    }
+    ThreadPool& pool = blockPool();
+    std::vector<std::future<void>> results = std::vector<std::future<void>>();
+    for (const MemoryBlock& block : blocks) {
+        std::byte* dest = out.data() + block.rawOffset;
+        results.push_back(pool.submit([&block, dest]() {
+            decodeMemoryBlock(block, dest);
+        }));
+    }
+    // the tasks use blocks and out, so all of them must finish before returning
+    pool.waitAll(results);
+}
+
+std::vector<std::byte> compressBuffer(
+        const std::byte* data, const std::size_t n, const CscOptions& options) {
+    std::vector<std::byte> out = std::vector<std::byte>();
+    Encoder(options).compress(data, n, out);
+    return out;
+}
+
+std::vector<std::byte> decompressBuffer(
+        const std::byte* data, const std::size_t n, const CscOptions& options) {
+    std::vector<std::byte> out = std::vector<std::byte>();
+    Decoder(options).decompress(data, n, out);
+    return out;
+}
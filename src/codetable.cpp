@@ -0,0 +1,501 @@
+#include <codetable.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+static inline std::uint64_t alignedBits(const HuffCode& c) {
+    return c.bits << (64 - c.length);
+}
+
+DecodeTable::DecodeTable(std::vector<HuffCode> codes) {
+    singleSymbol = false;
+    primaryOnly = false;
+    onlySymbol = 0;
+    maxLength = 0;
+    if (codes.size() == 1 && codes[0].length == 0) {
+        singleSymbol = true;
+        onlySymbol = codes[0].symbol;
+        primaryBits = 0;
+        return;
+    }
+    for (const HuffCode& c : codes) {
+        if (c.length == 0 || c.length > MAX_DECODABLE_CODE_LENGTH)
+            throw std::runtime_error("Unsupported Huffman code length "
+                                     + std::to_string(c.length));
+        maxLength = std::max(maxLength, (unsigned) c.length);
+    }
+    std::sort(codes.begin(), codes.end(), [](const HuffCode& a, const HuffCode& b) {
+        return alignedBits(a) < alignedBits(b);
+    });
+    primaryBits = std::min(std::max(maxLength, 1U), DECODE_PRIMARY_BITS);
+    const DecodeEntry invalid = {0, 0, 0, DECODE_INVALID};
+    entries.assign((std::size_t) 1 << primaryBits, invalid);
+    fill(0, primaryBits, 0, codes.data(), codes.data() + codes.size());
+    pairPrimaryEntries();
+    primaryOnly = maxLength <= primaryBits && std::none_of(
+        entries.begin(), entries.end(),
+        [](const DecodeEntry& e) { return e.count == DECODE_INVALID; });
+}
+
+std::uint64_t codedBits(
+        const std::vector<std::uint64_t>& freqs, const std::vector<std::uint8_t>& lengths) {
+    std::uint64_t bits = 0;
+    for (std::size_t i = 0; i < freqs.size() && i < lengths.size(); i++)
+        bits += freqs[i] * lengths[i];
+    return bits;
+}
+
+std::vector<HuffCode> canonicalCodes(const std::vector<std::uint8_t>& lengths) {
+    std::vector<std::size_t> lengthCount(MAX_DECODABLE_CODE_LENGTH + 1, 0);
+    for (std::uint8_t len : lengths) {
+        if (len > MAX_DECODABLE_CODE_LENGTH)
+            throw std::runtime_error("Unsupported Huffman code length "
+                                     + std::to_string(len));
+        lengthCount[len]++;
+    }
+    lengthCount[0] = 0;
+    std::vector<std::uint64_t> nextCode(MAX_DECODABLE_CODE_LENGTH + 1, 0);
+    std::uint64_t code = 0;
+    for (unsigned len = 1; len <= MAX_DECODABLE_CODE_LENGTH; len++) {
+        code = (code + lengthCount[len - 1]) << 1;
+        nextCode[len] = code;
+        if (len < 64 && code + lengthCount[len] > ((std::uint64_t) 1 << len))
+            throw std::runtime_error("Over-subscribed Huffman code lengths");
+    }
+    std::vector<HuffCode> codes = std::vector<HuffCode>();
+    for (std::size_t sym = 0; sym < lengths.size(); sym++) {
+        if (lengths[sym] != 0)
+            codes.push_back({nextCode[lengths[sym]]++, lengths[sym], (std::uint16_t) sym});
+    }
+    return codes;
+}
+
+// An item in one package-merge list: a leaf (symbol >= 0) or a package
+// of two items from the list one level deeper
+struct MergeItem {
+    std::uint64_t weight;
+    int symbol;
+    std::size_t left;
+    std::size_t right;
+};
+
+std::vector<std::uint8_t> limitedCodeLengths(
+        const std::vector<std::uint64_t>& freqs, const unsigned maxLength) {
+    std::vector<std::uint8_t> lengths(freqs.size(), 0);
+    std::vector<MergeItem> leaves = std::vector<MergeItem>();
+    for (std::size_t sym = 0; sym < freqs.size(); sym++) {
+        if (freqs[sym] > 0)
+            leaves.push_back({freqs[sym], (int) sym, 0, 0});
+    }
+    if (leaves.size() <= 1) {
+        for (const MergeItem& leaf : leaves)
+            lengths[leaf.symbol] = 1;
+        return lengths;
+    }
+    if (maxLength >= 64 || ((std::uint64_t) 1 << maxLength) < leaves.size()
+            || maxLength > MAX_DECODABLE_CODE_LENGTH)
+        throw std::invalid_argument("Can't fit " + std::to_string(leaves.size())
+                                    + " codes in " + std::to_string(maxLength) + " bits");
+    std::stable_sort(leaves.begin(), leaves.end(), [](const MergeItem& a, const MergeItem& b) {
+        return a.weight < b.weight;
+    });
+    // levels[0] holds the deepest (2^-maxLength) denomination
+    std::vector<std::vector<MergeItem>> levels(maxLength);
+    levels[0] = leaves;
+    for (unsigned l = 1; l < maxLength; l++) {
+        const std::vector<MergeItem>& prev = levels[l - 1];
+        std::vector<MergeItem>& cur = levels[l];
+        cur.reserve(leaves.size() + prev.size() / 2);
+        std::size_t li = 0;
+        for (std::size_t pi = 0; pi + 1 < prev.size(); pi += 2) {
+            MergeItem package = {prev[pi].weight + prev[pi + 1].weight, -1, pi, pi + 1};
+            while (li < leaves.size() && leaves[li].weight <= package.weight)
+                cur.push_back(leaves[li++]);
+            cur.push_back(package);
+        }
+        cur.insert(cur.end(), leaves.begin() + li, leaves.end());
+    }
+    // every leaf inside the cheapest 2n - 2 items is one bit deeper
+    std::vector<std::pair<unsigned, std::size_t>> stack = {};
+    const std::size_t selected = std::min(2 * leaves.size() - 2, levels.back().size());
+    for (std::size_t i = 0; i < selected; i++)
+        stack.push_back({maxLength - 1, i});
+    while (!stack.empty()) {
+        auto [level, idx] = stack.back();
+        stack.pop_back();
+        const MergeItem& item = levels[level][idx];
+        if (item.symbol >= 0) {
+            lengths[item.symbol]++;
+        } else {
+            stack.push_back({level - 1, item.left});
+            stack.push_back({level - 1, item.right});
+        }
+    }
+    return lengths;
+}
+
+std::vector<std::uint8_t> clampedCodeLengths(
+        const std::vector<std::uint64_t>& freqs, std::vector<std::uint8_t> lengths,
+        const unsigned maxLength) {
+    // the symbols with codes, rarest first
+    std::vector<std::size_t> order = std::vector<std::size_t>();
+    for (std::size_t sym = 0; sym < lengths.size(); sym++) {
+        if (lengths[sym] != 0)
+            order.push_back(sym);
+    }
+    if (maxLength >= 64 || ((std::uint64_t) 1 << maxLength) < order.size())
+        throw std::invalid_argument("Can't fit " + std::to_string(order.size())
+                                    + " codes in " + std::to_string(maxLength) + " bits");
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return freqs[a] < freqs[b];
+    });
+    // the Kraft sum in units of 2^-maxLength, which a prefix code keeps within capacity
+    const std::uint64_t capacity = (std::uint64_t) 1 << maxLength;
+    std::uint64_t kraft = 0;
+    for (std::size_t sym : order) {
+        lengths[sym] = (std::uint8_t) std::min<unsigned>(lengths[sym], maxLength);
+        kraft += (std::uint64_t) 1 << (maxLength - lengths[sym]);
+    }
+    while (kraft > capacity) {
+        // lengthen the code that frees the most of the excess per coded bit it adds
+        std::size_t best = order.size();
+        double bestCost = 0;
+        for (std::size_t i = 0; i < order.size(); i++) {
+            const std::uint8_t len = lengths[order[i]];
+            if (len >= maxLength)
+                continue;
+            std::uint64_t freed = std::min<std::uint64_t>(
+                (std::uint64_t) 1 << (maxLength - len - 1), kraft - capacity);
+            double cost = (double) freqs[order[i]] / freed;
+            if (best == order.size() || cost < bestCost) {
+                best = i;
+                bestCost = cost;
+            }
+        }
+        std::uint8_t& len = lengths[order[best]];
+        kraft -= (std::uint64_t) 1 << (maxLength - len - 1);
+        len++;
+    }
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        std::uint8_t& len = lengths[*it];
+        while (len > 1 && kraft + ((std::uint64_t) 1 << (maxLength - len)) <= capacity) {
+            kraft += (std::uint64_t) 1 << (maxLength - len);
+            len--;
+        }
+    }
+    return lengths;
+}
+
+EncodeTable::EncodeTable(const std::size_t alphabetSize) :
+    codes(alphabetSize), maxLength(0) {
+    for (std::size_t i = 0; i < alphabetSize; i++)
+        codes[i] = {0, 0, (std::uint16_t) i};
+}
+
+EncodeTable::EncodeTable(
+        const std::vector<HuffCode>& codes, const std::size_t alphabetSize) :
+    EncodeTable(alphabetSize) {
+    for (const HuffCode& c : codes)
+        set(c);
+}
+
+void EncodeTable::set(const HuffCode& code) {
+    codes.at(code.symbol) = code;
+    maxLength = std::max(maxLength, (unsigned) code.length);
+}
+
+void DecodeTable::fill(std::size_t offset, unsigned width, unsigned consumed,
+                       const HuffCode* first, const HuffCode* last) {
+    const DecodeEntry invalid = {0, 0, 0, DECODE_INVALID};
+    auto indexOf = [&](const HuffCode& c) {
+        return (std::size_t) ((alignedBits(c) << consumed) >> (64 - width));
+    };
+    for (const HuffCode* c = first; c != last;) {
+        std::size_t idx = indexOf(*c);
+        unsigned rem = c->length - consumed;
+        if (rem <= width) {
+            std::size_t span = (std::size_t) 1 << (width - rem);
+            DecodeEntry e = {c->symbol, (std::uint8_t) rem, (std::uint8_t) rem, 1};
+            std::fill(entries.begin() + offset + idx,
+                      entries.begin() + offset + idx + span, e);
+            ++c;
+            continue;
+        }
+        // every longer code sharing this index goes into one sub-table
+        const HuffCode* groupEnd = c;
+        unsigned maxRem = 0;
+        while (groupEnd != last && indexOf(*groupEnd) == idx) {
+            maxRem = std::max(maxRem, groupEnd->length - consumed);
+            ++groupEnd;
+        }
+        unsigned subWidth = std::min(maxRem - width, DECODE_SUBTABLE_BITS);
+        std::size_t subOffset = entries.size();
+        entries.resize(subOffset + ((std::size_t) 1 << subWidth), invalid);
+        entries[offset + idx] = {(std::uint32_t) subOffset, (std::uint8_t) subWidth,
+                                 0, DECODE_LINK};
+        fill(subOffset, subWidth, consumed + width, c, groupEnd);
+        c = groupEnd;
+    }
+}
+
+void DecodeTable::pairPrimaryEntries() {
+    // a second symbol fits when its whole code lies in the unused index bits
+    const std::size_t size = (std::size_t) 1 << primaryBits;
+    const std::size_t mask = size - 1;
+    std::vector<DecodeEntry> single(entries.begin(), entries.begin() + size);
+    for (std::size_t i = 0; i < size; i++) {
+        const DecodeEntry& e = single[i];
+        if (e.count != 1 || e.length >= primaryBits)
+            continue;
+        const DecodeEntry& next = single[(i << e.length) & mask];
+        if (next.count != 1 || next.length > primaryBits - e.length)
+            continue;
+        entries[i].value = e.value | (next.value << 16);
+        entries[i].length = e.length + next.length;
+        entries[i].count = 2;
+    }
+}
+
+// K codes of at most 56 / K bits fit after a flush, so skip the
+// per-symbol capacity check
+template <int K>
+static std::size_t encodeInGroups(
+        const HuffCode* codes, const std::byte* in, const std::size_t n, BitWriter& bw) {
+    std::size_t i = 0;
+    for (; i + K <= n; i += K) {
+        bw.flush();
+        for (int k = 0; k < K; k++) {
+            const HuffCode& c = codes[(unsigned char) in[i + k]];
+            bw.put(c.bits, c.length);
+        }
+    }
+    return i;
+}
+
+void encodeBytes(
+        const EncodeTable& table, const std::byte* in, const std::size_t n, BitWriter& bw) {
+    if (table.maxLength == 0)
+        return; // a single symbol with an empty code
+    const HuffCode* codes = table.codes.data();
+    std::size_t i = 0;
+    if (table.maxLength <= 14)
+        i = encodeInGroups<4>(codes, in, n, bw);
+    else if (table.maxLength <= 18)
+        i = encodeInGroups<3>(codes, in, n, bw);
+    else if (table.maxLength <= 28)
+        i = encodeInGroups<2>(codes, in, n, bw);
+    for (; i < n; i++) {
+        const HuffCode& c = codes[(unsigned char) in[i]];
+        bw.writeLong(c.bits, c.length);
+    }
+}
+
+void decodeBytes(
+        const DecodeTable& table, BitReader& br, std::byte* out, const std::size_t n) {
+    if (table.singleSymbol) {
+        std::fill(out, out + n, (std::byte) table.onlySymbol);
+        return;
+    }
+    const DecodeEntry* entries = table.entries.data();
+    const unsigned pb = table.primaryBits;
+    std::size_t i = 0;
+    if (table.primaryOnly) {
+        // no sub-tables: each lookup uses at most pb bits, so one refill
+        // covers four lookups of up to two symbols each
+        while (i + 8 <= n) {
+            br.refill();
+            for (int k = 0; k < 4; k++) {
+                const DecodeEntry e = entries[br.peek(pb)];
+                out[i] = (std::byte) e.value;
+                out[i + 1] = (std::byte) (e.value >> 16);
+                i += e.count;
+                br.consume(e.length);
+            }
+        }
+    }
+    while (i < n) {
+        br.refill();
+        DecodeEntry e = entries[br.peek(pb)];
+        unsigned width = pb;
+        while (e.count == DECODE_LINK) {
+            br.consume(width);
+            br.refill();
+            width = e.length;
+            e = entries[e.value + br.peek(width)];
+        }
+        if (e.count == DECODE_INVALID)
+            throw std::runtime_error("Invalid Huffman code in compressed data");
+        if (e.count == 2 && i + 1 < n) {
+            out[i] = (std::byte) e.value;
+            out[i + 1] = (std::byte) (e.value >> 16);
+            i += 2;
+            br.consume(e.length);
+        } else {
+            out[i++] = (std::byte) e.value;
+            br.consume(e.firstLength);
+        }
+    }
+}
+
+/* Bit reader state for one interleaved stream. It lives in decodeInterleaved's
+locals, whose address never escapes, so the compiler can keep it in registers
+even though the byte stores to the output could alias any memory. */
+struct LaneBits {
+    const std::byte* pos;
+    const std::byte* end;
+    std::uint64_t bits;
+    unsigned count;
+    unsigned paddingBits;
+};
+
+// As BitReader::refill: at least 56 bits can be peeked afterwards
+static inline void refillLane(LaneBits& l) {
+    if (l.end - l.pos >= 8) {
+        l.bits |= loadBigEndian64(l.pos) >> l.count;
+        l.pos += (63 - l.count) >> 3;
+        l.count |= 56;
+        return;
+    }
+    while (l.count <= 56) {
+        if (l.pos != l.end)
+            l.bits |= ((std::uint64_t) *l.pos++) << (56 - l.count);
+        else
+            l.paddingBits += 8;
+        l.count += 8;
+    }
+}
+
+static inline std::uint64_t peekLane(const LaneBits& l, const unsigned n) {
+    return l.bits >> (64 - n);
+}
+
+static inline void consumeLane(LaneBits& l, const unsigned n) {
+    l.bits <<= n;
+    l.count -= n;
+}
+
+/* Finds the entry for the next code, following sub-table links and leaving
+the bits of the final entry unconsumed. The lane must have been refilled. */
+static inline DecodeEntry lookupLane(
+        const DecodeEntry* entries, const unsigned pb, LaneBits& l) {
+    DecodeEntry e = entries[peekLane(l, pb)];
+    unsigned width = pb;
+    while (e.count == DECODE_LINK) {
+        consumeLane(l, width);
+        refillLane(l);
+        width = e.length;
+        e = entries[e.value + peekLane(l, width)];
+    }
+    if (e.count == DECODE_INVALID)
+        throw std::runtime_error("Invalid Huffman code in compressed data");
+    return e;
+}
+
+// Writes the entry's symbols (the second only if there's room) and consumes their bits
+static inline void emitLane(
+        const DecodeEntry e, LaneBits& l, std::byte* out, std::size_t& i, const std::size_t n) {
+    out[i] = (std::byte) e.value;
+    if (e.count == 2 && i + 1 < n) {
+        out[i + 1] = (std::byte) (e.value >> 16);
+        i += 2;
+        consumeLane(l, e.length);
+    } else {
+        i += 1;
+        consumeLane(l, e.firstLength);
+    }
+}
+
+void decodeInterleaved(
+        const DecodeTable& table, const std::byte* const* streams,
+        const std::size_t* streamSizes, std::byte* const* outs, const std::size_t* sizes) {
+    static_assert(INTERLEAVED_STREAMS == 4, "decodeInterleaved is unrolled for four streams");
+    if (table.singleSymbol) {
+        for (std::size_t s = 0; s < INTERLEAVED_STREAMS; s++)
+            std::fill(outs[s], outs[s] + sizes[s], (std::byte) table.onlySymbol);
+        return;
+    }
+    LaneBits l0 = {streams[0], streams[0] + streamSizes[0], 0, 0, 0};
+    LaneBits l1 = {streams[1], streams[1] + streamSizes[1], 0, 0, 0};
+    LaneBits l2 = {streams[2], streams[2] + streamSizes[2], 0, 0, 0};
+    LaneBits l3 = {streams[3], streams[3] + streamSizes[3], 0, 0, 0};
+    std::byte* o0 = outs[0];
+    std::byte* o1 = outs[1];
+    std::byte* o2 = outs[2];
+    std::byte* o3 = outs[3];
+    std::size_t i0 = 0, i1 = 0, i2 = 0, i3 = 0;
+    // parts are equal but for a shorter last one, so it runs out of room first
+    const std::size_t n = sizes[3];
+    const DecodeEntry* entries = table.entries.data();
+    const unsigned pb = table.primaryBits;
+    if (table.primaryOnly) {
+        // as in decodeBytes, one refill covers four lookups of up to two symbols
+        while (std::max(std::max(i0, i1), std::max(i2, i3)) + 8 <= n) {
+            refillLane(l0);
+            refillLane(l1);
+            refillLane(l2);
+            refillLane(l3);
+            for (int k = 0; k < 4; k++) {
+                const DecodeEntry e0 = entries[peekLane(l0, pb)];
+                const DecodeEntry e1 = entries[peekLane(l1, pb)];
+                const DecodeEntry e2 = entries[peekLane(l2, pb)];
+                const DecodeEntry e3 = entries[peekLane(l3, pb)];
+                consumeLane(l0, e0.length);
+                consumeLane(l1, e1.length);
+                consumeLane(l2, e2.length);
+                consumeLane(l3, e3.length);
+                o0[i0] = (std::byte) e0.value;
+                o0[i0 + 1] = (std::byte) (e0.value >> 16);
+                o1[i1] = (std::byte) e1.value;
+                o1[i1 + 1] = (std::byte) (e1.value >> 16);
+                o2[i2] = (std::byte) e2.value;
+                o2[i2 + 1] = (std::byte) (e2.value >> 16);
+                o3[i3] = (std::byte) e3.value;
+                o3[i3 + 1] = (std::byte) (e3.value >> 16);
+                i0 += e0.count;
+                i1 += e1.count;
+                i2 += e2.count;
+                i3 += e3.count;
+            }
+        }
+    } else {
+        while (std::max(std::max(i0, i1), std::max(i2, i3)) + 2 <= n) {
+            refillLane(l0);
+            refillLane(l1);
+            refillLane(l2);
+            refillLane(l3);
+            const DecodeEntry e0 = lookupLane(entries, pb, l0);
+            const DecodeEntry e1 = lookupLane(entries, pb, l1);
+            const DecodeEntry e2 = lookupLane(entries, pb, l2);
+            const DecodeEntry e3 = lookupLane(entries, pb, l3);
+            // with room for both symbols, the pair needs no branch
+            consumeLane(l0, e0.length);
+            consumeLane(l1, e1.length);
+            consumeLane(l2, e2.length);
+            consumeLane(l3, e3.length);
+            o0[i0] = (std::byte) e0.value;
+            o0[i0 + 1] = (std::byte) (e0.value >> 16);
+            o1[i1] = (std::byte) e1.value;
+            o1[i1 + 1] = (std::byte) (e1.value >> 16);
+            o2[i2] = (std::byte) e2.value;
+            o2[i2 + 1] = (std::byte) (e2.value >> 16);
+            o3[i3] = (std::byte) e3.value;
+            o3[i3 + 1] = (std::byte) (e3.value >> 16);
+            i0 += e0.count;
+            i1 += e1.count;
+            i2 += e2.count;
+            i3 += e3.count;
+        }
+    }
+    // the last few symbols of each stream, one lane at a time
+    LaneBits* lanes[INTERLEAVED_STREAMS] = {&l0, &l1, &l2, &l3};
+    std::size_t done[INTERLEAVED_STREAMS] = {i0, i1, i2, i3};
+    for (std::size_t s = 0; s < INTERLEAVED_STREAMS; s++) {
+        LaneBits& l = *lanes[s];
+        for (std::size_t i = done[s]; i < sizes[s];) {
+            refillLane(l);
+            emitLane(lookupLane(entries, pb, l), l, outs[s], i, sizes[s]);
+        }
+        if (l.count < l.paddingBits)
+            throw std::runtime_error("Compressed data is truncated");
+    }
+}
@@ -0,0 +1,110 @@
+#include <context.hpp>
+#include <algorithm>
+#include <cmath>
+
+constexpr unsigned CLUSTER_ROUNDS = 8;
+
+ContextModel buildContextModel(const std::byte* data, const std::size_t n, const unsigned maxClusters) {
+    std::vector<std::uint64_t> counts(256 * 256, 0);
+    std::uint8_t prev = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        const std::uint8_t b = (std::uint8_t) data[i];
+        counts[prev * 256 + b]++;
+        prev = b;
+    }
+    // each used context's symbols, so distances only visit nonzero counts
+    std::vector<std::uint8_t> used = std::vector<std::uint8_t>();
+    std::vector<std::uint64_t> contextTotal(256, 0);
+    std::vector<std::vector<std::uint8_t>> symbolsOf(256);
+    for (unsigned ctx = 0; ctx < 256; ctx++) {
+        for (unsigned s = 0; s < 256; s++) {
+            if (counts[ctx * 256 + s] > 0) {
+                symbolsOf[ctx].push_back((std::uint8_t) s);
+                contextTotal[ctx] += counts[ctx * 256 + s];
+            }
+        }
+        if (contextTotal[ctx] > 0)
+            used.push_back((std::uint8_t) ctx);
+    }
+    // seed with the busiest contexts
+    std::stable_sort(used.begin(), used.end(), [&](const std::uint8_t a, const std::uint8_t b) {
+        return contextTotal[a] > contextTotal[b];
+    });
+    const unsigned k = std::min<unsigned>(maxClusters, (unsigned) used.size());
+    ContextModel model;
+    for (unsigned c = 0; c < k; c++)
+        model.clusterOf[used[c]] = (std::uint8_t) c;
+    for (std::size_t i = k; i < used.size(); i++)
+        model.clusterOf[used[i]] = 0;
+    std::vector<std::vector<std::uint64_t>> freqs(k, std::vector<std::uint64_t>(256, 0));
+    std::vector<double> cost(k * 256);
+    for (unsigned round = 0; round <= CLUSTER_ROUNDS; round++) {
+        for (auto& f : freqs)
+            std::fill(f.begin(), f.end(), 0);
+        for (std::uint8_t ctx : used) {
+            for (std::uint8_t s : symbolsOf[ctx])
+                freqs[model.clusterOf[ctx]][s] += counts[ctx * 256 + s];
+        }
+        if (round == CLUSTER_ROUNDS || k < 2)
+            break;
+        // bits per symbol under each cluster, smoothed so unseen symbols aren't free
+        for (unsigned c = 0; c < k; c++) {
+            std::uint64_t total = 0;
+            for (std::uint64_t f : freqs[c])
+                total += f;
+            for (unsigned s = 0; s < 256; s++)
+                cost[c * 256 + s] = std::log2((total + 128.0) / (freqs[c][s] + 0.5));
+        }
+        bool changed = false;
+        for (std::uint8_t ctx : used) {
+            unsigned best = model.clusterOf[ctx];
+            double bestBits = -1;
+            for (unsigned c = 0; c < k; c++) {
+                double bits = 0;
+                for (std::uint8_t s : symbolsOf[ctx])
+                    bits += counts[ctx * 256 + s] * cost[c * 256 + s];
+                if (bestBits < 0 || bits < bestBits) {
+                    bestBits = bits;
+                    best = c;
+                }
+            }
+            changed = changed || best != model.clusterOf[ctx];
+            model.clusterOf[ctx] = (std::uint8_t) best;
+        }
+        if (!changed)
+            break;
+    }
+    // renumber the clusters left with symbols
+    std::vector<int> renumbered(k, -1);
+    for (unsigned c = 0; c < k; c++) {
+        if (std::any_of(freqs[c].begin(), freqs[c].end(), [](std::uint64_t f) { return f > 0; })) {
+            renumbered[c] = (int) model.numClusters++;
+            model.freqs.push_back(freqs[c]);
+        }
+    }
+    for (std::uint8_t ctx : used)
+        model.clusterOf[ctx] = (std::uint8_t) renumbered[model.clusterOf[ctx]];
+    return model;
+}
+
+void encodeBytesWithContext(
+        const EncodeTable* tables, const std::uint8_t* clusterOf,
+        const std::byte* in, const std::size_t n, BitWriter& bw) {
+    std::uint8_t prev = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        const std::uint8_t b = (std::uint8_t) in[i];
+        const HuffCode& c = tables[clusterOf[prev]].codes[b];
+        bw.writeLong(c.bits, c.length);
+        prev = b;
+    }
+}
+
+void decodeBytesWithContext(
+        const DecodeTable* tables, const std::uint8_t* clusterOf,
+        BitReader& br, std::byte* out, const std::size_t n) {
+    std::uint8_t prev = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        prev = (std::uint8_t) decodeSymbol(tables[clusterOf[prev]], br);
+        out[i] = (std::byte) prev;
+    }
+}
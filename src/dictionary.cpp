@@ -0,0 +1,260 @@
+#include <dictionary.hpp>
+#include <checksum.hpp>
+#include <histogram.hpp>
+#include <huffer.hpp>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+constexpr unsigned TRAINING_ROUNDS = 8;
+// a sample must cost this many bits more than its entropy to seed a new table
+constexpr double MIN_SEED_EXCESS_BITS = 8;
+// an unseen byte value weighs this many times less than one seen once
+constexpr std::uint64_t UNSEEN_BYTE_WEIGHT = 64;
+
+// A sample's nonzero byte counts, so costs only visit the symbols it uses
+struct SparseSample {
+    std::vector<std::uint8_t> symbols;
+    std::vector<std::uint64_t> counts;
+};
+
+static std::uint64_t sampleBits(const SparseSample& sample, const std::vector<std::uint8_t>& lengths) {
+    std::uint64_t bits = 0;
+    for (std::size_t i = 0; i < sample.symbols.size(); i++)
+        bits += sample.counts[i] * lengths[sample.symbols[i]];
+    return bits;
+}
+
+// Code lengths for freqs, with a code for every byte value even if unseen.
+static std::vector<std::uint8_t> fullTableLengths(
+        std::vector<std::uint64_t> freqs, const unsigned maxCodeLength) {
+    for (std::uint64_t& f : freqs)
+        f = f * UNSEEN_BYTE_WEIGHT + 1;
+    return huffmanCodeLengths(freqs, maxCodeLength);
+}
+
+// Sets the encode tables and ID of a dictionary from its lengths
+static void finishDictionary(CscDictionary& dictionary) {
+    dictionary.encodeTables.clear();
+    for (const std::vector<std::uint8_t>& lengths : dictionary.lengths)
+        dictionary.encodeTables.emplace_back(canonicalCodes(lengths));
+    std::vector<std::byte> bytes = dictionaryBytes(dictionary);
+    dictionary.id = loadChecksum(bytes.data() + bytes.size() - CHECKSUM_SIZE);
+}
+
+CscDictionary trainDictionary(
+        const std::vector<std::vector<std::uint64_t>>& samples,
+        const unsigned numTables, const unsigned maxCodeLength) {
+    if (samples.empty())
+        throw std::invalid_argument("No samples to train a dictionary on");
+    std::vector<SparseSample> sparse(samples.size());
+    std::vector<double> entropy(samples.size());
+    std::vector<std::uint64_t> total(256, 0);
+    for (std::size_t i = 0; i < samples.size(); i++) {
+        for (unsigned s = 0; s < 256; s++) {
+            if (samples[i][s] > 0) {
+                sparse[i].symbols.push_back((std::uint8_t) s);
+                sparse[i].counts.push_back(samples[i][s]);
+                total[s] += samples[i][s];
+            }
+        }
+        entropy[i] = entropyBits(samples[i]);
+    }
+    std::vector<std::vector<std::uint8_t>> tables = {fullTableLengths(total, maxCodeLength)};
+    std::vector<unsigned> tableOf(samples.size(), 0);
+    // moves each sample to its cheapest table, then rebuilds the tables from
+    // their samples, dropping any left without one; returns whether any moved
+    auto refine = [&]() {
+        bool moved = false;
+        for (std::size_t i = 0; i < sparse.size(); i++) {
+            unsigned best = tableOf[i];
+            std::uint64_t bestBits = sampleBits(sparse[i], tables[best]);
+            for (unsigned t = 0; t < tables.size(); t++) {
+                std::uint64_t bits = sampleBits(sparse[i], tables[t]);
+                if (bits < bestBits) {
+                    bestBits = bits;
+                    best = t;
+                }
+            }
+            moved = moved || best != tableOf[i];
+            tableOf[i] = best;
+        }
+        std::vector<std::vector<std::uint64_t>> freqs(tables.size(), std::vector<std::uint64_t>(256, 0));
+        std::vector<bool> used(tables.size(), false);
+        for (std::size_t i = 0; i < sparse.size(); i++) {
+            used[tableOf[i]] = true;
+            for (std::size_t j = 0; j < sparse[i].symbols.size(); j++)
+                freqs[tableOf[i]][sparse[i].symbols[j]] += sparse[i].counts[j];
+        }
+        std::vector<unsigned> renumbered(tables.size(), 0);
+        tables.clear();
+        for (unsigned t = 0; t < freqs.size(); t++) {
+            if (used[t]) {
+                renumbered[t] = (unsigned) tables.size();
+                tables.push_back(fullTableLengths(freqs[t], maxCodeLength));
+            }
+        }
+        for (unsigned& t : tableOf)
+            t = renumbered[t];
+        return moved;
+    };
+    while (tables.size() < numTables) {
+        // seed a table with the sample its current table fits worst
+        std::size_t worst = 0;
+        double worstExcess = 0;
+        for (std::size_t i = 0; i < sparse.size(); i++) {
+            double excess = sampleBits(sparse[i], tables[tableOf[i]]) - entropy[i];
+            if (excess > worstExcess) {
+                worstExcess = excess;
+                worst = i;
+            }
+        }
+        if (worstExcess < MIN_SEED_EXCESS_BITS)
+            break;
+        const std::size_t before = tables.size();
+        tables.push_back(fullTableLengths(samples[worst], maxCodeLength));
+        refine();
+        if (tables.size() <= before)
+            break;
+    }
+    for (unsigned round = 0; round < TRAINING_ROUNDS && refine(); round++)
+        ;
+    CscDictionary dictionary;
+    dictionary.lengths = tables;
+    finishDictionary(dictionary);
+    return dictionary;
+}
+
+CscDictionary trainDictionary(
+        const std::vector<std::string>& paths,
+        const unsigned numTables, const unsigned maxCodeLength) {
+    std::vector<std::string> files = std::vector<std::string>();
+    for (const std::string& path : paths) {
+        if (std::filesystem::is_directory(path)) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+                if (entry.is_regular_file())
+                    files.push_back(entry.path().string());
+            }
+        } else if (std::filesystem::is_regular_file(path)) {
+            files.push_back(path);
+        } else {
+            throw std::invalid_argument("Can't read " + path);
+        }
+    }
+    // directory order varies, and the sample order decides ties
+    std::sort(files.begin(), files.end());
+    const std::size_t count = std::min(files.size(), MAX_DICTIONARY_SAMPLES);
+    std::vector<std::vector<std::uint64_t>> samples = std::vector<std::vector<std::uint64_t>>();
+    std::vector<char> buffer(DICTIONARY_SAMPLE_BYTES);
+    for (std::size_t k = 0; k < count; k++) {
+        const std::string& file = files[k * files.size() / count];
+        std::ifstream rf(file, std::ios::in | std::ios::binary);
+        if (!rf)
+            throw std::invalid_argument("Can't read " + file);
+        rf.read(buffer.data(), buffer.size());
+        if (rf.gcount() > 0)
+            samples.push_back(byteHistogram(
+                reinterpret_cast<const std::byte*>(buffer.data()), (std::size_t) rf.gcount()));
+    }
+    return trainDictionary(samples, numTables, maxCodeLength);
+}
+
+std::vector<std::byte> dictionaryBytes(const CscDictionary& dictionary) {
+    std::vector<std::byte> ret = std::vector<std::byte>();
+    // +MAGIC
+    for (std::size_t i = 0; i < CSC_DICTIONARY_MAGIC_SIZE; i++)
+        ret.push_back((std::byte) CSC_DICTIONARY_MAGIC[i]);
+    // +VERSION
+    ret.push_back((std::byte) CSC_DICTIONARY_VERSION);
+    // +NUM_TABLES
+    ret.push_back((std::byte) dictionary.lengths.size());
+    // +TABLES
+    for (const std::vector<std::uint8_t>& lengths : dictionary.lengths)
+        packCodeLengths(ret, lengths);
+    // +CHECKSUM
+    putChecksum(ret, crc32c(0, ret.data(), ret.size()));
+    return ret;
+}
+
+CscDictionary parseDictionary(const std::byte* data, const std::size_t n) {
+    if (n < CSC_DICTIONARY_MAGIC_SIZE
+            || std::memcmp(data, CSC_DICTIONARY_MAGIC, CSC_DICTIONARY_MAGIC_SIZE) != 0)
+        throw std::runtime_error("Not a dictionary file");
+    if (n < CSC_DICTIONARY_MAGIC_SIZE + CHECKSUM_SIZE
+            || crc32c(0, data, n - CHECKSUM_SIZE) != loadChecksum(data + n - CHECKSUM_SIZE))
+        throw std::runtime_error("Checksum mismatch: the dictionary is corrupt");
+    ByteCursor cur(data, n - CHECKSUM_SIZE);
+    cur.take(CSC_DICTIONARY_MAGIC_SIZE);
+    if (cur.next() != CSC_DICTIONARY_VERSION)
+        throw std::runtime_error("Unsupported dictionary version");
+    CscDictionary dictionary;
+    const unsigned numTables = cur.next();
+    for (unsigned t = 0; t < numTables; t++) {
+        std::vector<std::uint8_t> lengths = unpackCodeLengths(cur, 256);
+        // every byte value needs a code, and the codes must form a prefix code
+        std::uint64_t kraft = 0;
+        for (std::uint8_t len : lengths) {
+            if (len == 0 || len > MAX_MAX_CODE_LENGTH)
+                throw std::runtime_error("Malformed table in dictionary");
+            kraft += (std::uint64_t) 1 << (MAX_MAX_CODE_LENGTH - len);
+        }
+        if (kraft > (std::uint64_t) 1 << MAX_MAX_CODE_LENGTH)
+            throw std::runtime_error("Malformed table in dictionary");
+        dictionary.lengths.push_back(lengths);
+    }
+    if (numTables == 0 || cur.remaining() != 0)
+        throw std::runtime_error("Malformed dictionary");
+    finishDictionary(dictionary);
+    return dictionary;
+}
+
+void writeDictionary(const CscDictionary& dictionary, const std::string& path) {
+    std::ofstream wf(path, std::ios::out | std::ios::binary);
+    if (!wf)
+        throw std::invalid_argument("Can't write " + path);
+    std::vector<std::byte> bytes = dictionaryBytes(dictionary);
+    wf.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+CscDictionary readDictionary(const std::string& path) {
+    std::ifstream rf(path, std::ios::in | std::ios::binary);
+    if (!rf)
+        throw std::invalid_argument("Can't read " + path);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(rf)), std::istreambuf_iterator<char>());
+    return parseDictionary(reinterpret_cast<const std::byte*>(bytes.data()), bytes.size());
+}
+
+const EncodeTable& dictionaryEncodeTable(const CscDictionary& dictionary, const unsigned table) {
+    if (table >= dictionary.encodeTables.size())
+        throw std::invalid_argument("The dictionary has no table " + std::to_string(table));
+    return dictionary.encodeTables[table];
+}
+
+unsigned bestDictionaryTable(
+        const CscDictionary& dictionary, const std::vector<std::uint64_t>& freqs,
+        std::uint64_t& bits) {
+    unsigned best = 0;
+    bits = UINT64_MAX;
+    for (unsigned t = 0; t < dictionary.lengths.size(); t++) {
+        std::uint64_t tableBits = codedBits(freqs, dictionary.lengths[t]);
+        if (tableBits < bits) {
+            bits = tableBits;
+            best = t;
+        }
+    }
+    return best;
+}
+
+void useDictionary(CscHeader& header, const CscDictionary* dictionary) {
+    if (!(header.flags & CSC_FLAG_DICTIONARY))
+        return;
+    if (dictionary == nullptr)
+        throw std::invalid_argument("Compressed with a dictionary, which wasn't given");
+    if (header.dictionaryId != dictionary->id)
+        throw std::invalid_argument("Compressed with a different dictionary");
+    if (header.dictionaryTable >= dictionary->lengths.size())
+        throw std::runtime_error("Malformed dictionary table in compressed data");
+    header.codes = canonicalCodes(dictionary->lengths[header.dictionaryTable]);
+}
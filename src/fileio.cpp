@@ -0,0 +1,143 @@
+#include <fileio.hpp>
+#include <filesystem>
+#include <stdexcept>
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+PositionedFile::PositionedFile(const std::string& path, const bool writable) : path(path) {
+    auto mode = std::ios::in | std::ios::binary;
+    if (writable)
+        mode |= std::ios::out | std::ios::trunc;
+    file.open(path, mode);
+    if (!file)
+        throw std::invalid_argument("Can't open file " + path);
+}
+
+PositionedFile::~PositionedFile() {
+    file.close();
+}
+
+void PositionedFile::readAt(const std::uint64_t offset, std::byte* data, const std::size_t n) {
+    std::lock_guard<std::mutex> guard(lock);
+    file.seekg(offset);
+    file.read(reinterpret_cast<char*>(data), n);
+    if ((std::size_t) file.gcount() != n)
+        throw std::runtime_error("Unexpected end of file " + path);
+}
+
+void PositionedFile::writeAt(
+        const std::uint64_t offset, const std::byte* data, const std::size_t n) {
+    std::lock_guard<std::mutex> guard(lock);
+    file.seekp(offset);
+    if (!file.write(reinterpret_cast<const char*>(data), n))
+        throw std::runtime_error("Can't write to " + path);
+}
+
+void PositionedFile::resize(const std::uint64_t n) {
+    std::lock_guard<std::mutex> guard(lock);
+    file.flush();
+    std::filesystem::resize_file(path, n);
+}
+
+std::uint64_t PositionedFile::size() {
+    std::lock_guard<std::mutex> guard(lock);
+    file.flush();
+    return std::filesystem::file_size(path);
+}
+
+// no mapping here yet, so callers always take their streaming path
+MappedFile::MappedFile(const std::string& path) {}
+
+MappedFile::~MappedFile() {}
+
+#else
+
+PositionedFile::PositionedFile(const std::string& path, const bool writable) : path(path) {
+    fd = writable ? open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)
+                  : open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::invalid_argument("Can't open file " + path);
+}
+
+PositionedFile::~PositionedFile() {
+    close(fd);
+}
+
+void PositionedFile::readAt(const std::uint64_t offset, std::byte* data, const std::size_t n) {
+    for (std::size_t done = 0; done < n;) {
+        ssize_t got = pread(fd, data + done, n - done, offset + done);
+        if (got <= 0)
+            throw std::runtime_error("Unexpected end of file " + path);
+        done += got;
+    }
+}
+
+void PositionedFile::writeAt(
+        const std::uint64_t offset, const std::byte* data, const std::size_t n) {
+    for (std::size_t done = 0; done < n;) {
+        ssize_t put = pwrite(fd, data + done, n - done, offset + done);
+        if (put <= 0)
+            throw std::runtime_error("Can't write to " + path);
+        done += put;
+    }
+}
+
+void PositionedFile::resize(const std::uint64_t n) {
+    if (ftruncate(fd, n) != 0)
+        throw std::runtime_error("Can't resize " + path);
+}
+
+std::uint64_t PositionedFile::size() {
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        throw std::runtime_error("Can't stat " + path);
+    return st.st_size;
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::invalid_argument("Can't read " + path);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        length = st.st_size;
+        if (length == 0) {
+            isMapped = true;
+        } else {
+            void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, length, MADV_SEQUENTIAL);
+                base = static_cast<const std::byte*>(p);
+                isMapped = true;
+            }
+        }
+    }
+    close(fd);
+    if (!isMapped)
+        length = 0;
+}
+
+MappedFile::~MappedFile() {
+    if (base != nullptr)
+        munmap(const_cast<std::byte*>(base), length);
+}
+
+#endif
+
+bool MappedFile::mapped() const {
+    return isMapped;
+}
+
+const std::byte* MappedFile::data() const {
+    return base;
+}
+
+std::uint64_t MappedFile::size() const {
+    return length;
+}
@@ -0,0 +1,302 @@
+#include <format.hpp>
+#include <checksum.hpp>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+/*
+Version 2 Header Notation: ITEM [BYTE LENGTH OF ITEM]
+#####
+MAGIC [8]
+VERSION [1]
+FLAGS [1]
+NUMBER_CHARS_TOTAL [VARINT]
+NUM_EXT_CHARS [1]
+EXT_CHARS [NUM_EXT_CHARS]
+CHECKSUM [4]   (only if FLAGS has CSC_FLAG_CHECKSUM but not CSC_FLAG_BLOCKS)
+PACKED_CODE_LENGTHS [VARIES]   (only if FLAGS lacks CSC_FLAG_BLOCKS, CSC_FLAG_STORED and CSC_FLAG_DICTIONARY)
+DICTIONARY_ID [4]   (only if FLAGS has CSC_FLAG_DICTIONARY, see dictionary.hpp)
+DICTIONARY_TABLE [1]   (only if FLAGS has CSC_FLAG_DICTIONARY)
+MANIFEST [VARIES]   (only if FLAGS has CSC_FLAG_ARCHIVE, see archive.hpp)
+Codes are canonical, so the 256 code lengths are enough to rebuild them.
+VARINT is little-endian base 128 (7 bits per byte, high bit set on all but the last).
+PACKED_CODE_LENGTHS is a run of bytes, each one either
+   0-63: the code length of the next symbol
+   64-255: the previous code length (initially 0) repeated (BYTE - 63) more times
+until all 256 lengths are filled.
+*/
+
+constexpr unsigned MAX_PACKED_LENGTH = 63;
+
+void putVarint(std::vector<std::byte>& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((std::byte) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((std::byte) value);
+}
+
+void putLittleEndian32(std::vector<std::byte>& out, const std::uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        out.push_back((std::byte) (value >> (i * 8)));
+}
+
+void putLittleEndian64(std::vector<std::byte>& out, const std::uint64_t value) {
+    for (int i = 0; i < 8; i++)
+        out.push_back((std::byte) (value >> (i * 8)));
+}
+
+ByteCursor::ByteCursor(const std::byte* data, const std::size_t length) :
+    pos(data), end(data + length) {}
+
+unsigned char ByteCursor::next() {
+    if (pos == end)
+        throw std::runtime_error("Unexpected end of compressed data");
+    return (unsigned char) *pos++;
+}
+
+const std::byte* ByteCursor::take(const std::size_t n) {
+    if (remaining() < n)
+        throw std::runtime_error("Unexpected end of compressed data");
+    const std::byte* start = pos;
+    pos += n;
+    return start;
+}
+
+std::size_t ByteCursor::remaining() const {
+    return end - pos;
+}
+
+static unsigned char readByte(std::istream& rf) {
+    char b;
+    if (!rf.get(b))
+        throw std::runtime_error("Unexpected end of compressed header");
+    return (unsigned char) b;
+}
+
+static unsigned char readByte(ByteCursor& cur) {
+    return cur.next();
+}
+
+template <class Source>
+static std::uint64_t readVarintFrom(Source& src) {
+    std::uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        unsigned char b = readByte(src);
+        value |= (std::uint64_t) (b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+            return value;
+    }
+    throw std::runtime_error("Malformed varint in compressed data");
+}
+
+std::uint64_t readVarint(std::istream& rf) {
+    return readVarintFrom(rf);
+}
+
+std::uint64_t readVarint(ByteCursor& cur) {
+    return readVarintFrom(cur);
+}
+
+std::uint32_t loadLittleEndian32(const std::byte* p) {
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= (std::uint32_t) p[i] << (i * 8);
+    return value;
+}
+
+std::uint64_t readLittleEndian64(std::istream& rf) {
+    std::uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value |= (std::uint64_t) readByte(rf) << (i * 8);
+    return value;
+}
+
+void packCodeLengths(
+        std::vector<std::byte>& out, const std::vector<std::uint8_t>& lengths) {
+    std::uint8_t prev = 0;
+    for (std::size_t i = 0; i < lengths.size();) {
+        std::size_t run = 0;
+        while (i + run < lengths.size() && lengths[i + run] == prev && run < 192)
+            run++;
+        if (run > 0) {
+            out.push_back((std::byte) (63 + run));
+            i += run;
+            continue;
+        }
+        if (lengths[i] > MAX_PACKED_LENGTH)
+            throw std::invalid_argument("Code length too long for the header");
+        prev = lengths[i++];
+        out.push_back((std::byte) prev);
+    }
+}
+
+template <class Source>
+static std::vector<std::uint8_t> unpackCodeLengthsFrom(
+        Source& rf, const std::size_t alphabetSize) {
+    std::vector<std::uint8_t> lengths = std::vector<std::uint8_t>();
+    lengths.reserve(alphabetSize);
+    std::uint8_t prev = 0;
+    while (lengths.size() < alphabetSize) {
+        unsigned char b = readByte(rf);
+        if (b <= MAX_PACKED_LENGTH) {
+            prev = b;
+            lengths.push_back(b);
+        } else if (lengths.size() + (b - 63) <= alphabetSize) {
+            lengths.insert(lengths.end(), b - 63, prev);
+        } else {
+            throw std::runtime_error("Malformed code lengths in compressed data");
+        }
+    }
+    return lengths;
+}
+
+std::vector<std::uint8_t> unpackCodeLengths(
+        std::istream& rf, const std::size_t alphabetSize) {
+    return unpackCodeLengthsFrom(rf, alphabetSize);
+}
+
+std::vector<std::uint8_t> unpackCodeLengths(
+        ByteCursor& cur, const std::size_t alphabetSize) {
+    return unpackCodeLengthsFrom(cur, alphabetSize);
+}
+
+static std::vector<std::byte> genHeaderPrefix(
+        const std::string ext, const std::uint64_t n_total_chars, const std::uint8_t flags) {
+    std::vector<std::byte> ret = std::vector<std::byte>();
+    // +MAGIC
+    for (std::size_t i = 0; i < CSC_MAGIC_SIZE; i++)
+        ret.push_back((std::byte) CSC_MAGIC[i]);
+    // +VERSION
+    ret.push_back((std::byte) CSC_FORMAT_VERSION);
+    // +FLAGS
+    ret.push_back((std::byte) flags);
+    // +NUMBER_CHARS_TOTAL
+    putVarint(ret, n_total_chars);
+    // +NUM_EXT_CHARS
+    ret.push_back((std::byte) ext.length());
+    // +EXT_CHARS
+    for (std::size_t i = 0; i < ext.length(); i++)
+        ret.push_back((std::byte) ext[i]);
+    return ret;
+}
+
+// Appends CHECKSUM to a single-stream header prefix if there is one
+static void putHeaderChecksum(
+        std::vector<std::byte>& header, const std::optional<std::uint32_t> checksum) {
+    if (checksum) {
+        // +CHECKSUM
+        putChecksum(header, *checksum);
+    }
+}
+
+std::vector<std::byte> genHeaderBytesV2(
+        const std::string ext, const std::uint64_t n_total_chars,
+        const std::vector<std::uint8_t>& codeLengths,
+        const std::optional<std::uint32_t> checksum) {
+    std::vector<std::byte> ret = genHeaderPrefix(
+        ext, n_total_chars, checksum ? CSC_FLAG_CHECKSUM : 0);
+    putHeaderChecksum(ret, checksum);
+    // +PACKED_CODE_LENGTHS
+    packCodeLengths(ret, codeLengths);
+    return ret;
+}
+
+std::vector<std::byte> genDictionaryHeaderBytes(
+        const std::string ext, const std::uint64_t n_total_chars,
+        const std::uint32_t dictionaryId, const std::uint8_t table,
+        const std::optional<std::uint32_t> checksum) {
+    std::vector<std::byte> ret = genHeaderPrefix(
+        ext, n_total_chars, CSC_FLAG_DICTIONARY | (checksum ? CSC_FLAG_CHECKSUM : 0));
+    putHeaderChecksum(ret, checksum);
+    // +DICTIONARY_ID
+    putLittleEndian32(ret, dictionaryId);
+    // +DICTIONARY_TABLE
+    ret.push_back((std::byte) table);
+    return ret;
+}
+
+std::vector<std::byte> genBlockedHeaderBytes(
+        const std::string ext, const std::uint64_t n_total_chars,
+        const std::uint8_t extraFlags) {
+    return genHeaderPrefix(ext, n_total_chars, CSC_FLAG_BLOCKS | extraFlags);
+}
+
+std::vector<std::byte> genStoredHeaderBytes(
+        const std::string ext, const std::uint64_t n_total_chars,
+        const std::optional<std::uint32_t> checksum) {
+    std::vector<std::byte> ret = genHeaderPrefix(
+        ext, n_total_chars, CSC_FLAG_STORED | (checksum ? CSC_FLAG_CHECKSUM : 0));
+    putHeaderChecksum(ret, checksum);
+    return ret;
+}
+
+// Everything after NUMBER_CHARS_TOTAL in a version 1 header (see genHeaderBytes)
+static void readHeaderV1(std::istream& rf, CscHeader& header) {
+    unsigned extLen = readByte(rf);
+    for (unsigned i = 0; i < extLen; i++)
+        header.ext += (char) readByte(rf);
+    unsigned numUnique = 0;
+    for (std::size_t i = 0; i < sizeof(unsigned short); i++)
+        numUnique |= (unsigned) readByte(rf) << (i * CHAR_BIT);
+    for (unsigned i = 0; i < numUnique; i++) {
+        std::uint16_t character = readByte(rf);
+        unsigned codeLen = readByte(rf);
+        unsigned codeByteLen = (codeLen + CHAR_BIT - 1) / CHAR_BIT;
+        if (codeLen > MAX_DECODABLE_CODE_LENGTH)
+            throw std::runtime_error("Huffman code too long to decode");
+        std::uint64_t bits = 0;
+        for (unsigned j = 0; j < codeByteLen; j++)
+            bits = (bits << CHAR_BIT) | readByte(rf);
+        bits >>= codeByteLen * CHAR_BIT - codeLen;
+        header.codes.push_back({bits, (std::uint8_t) codeLen, character});
+    }
+}
+
+CscHeader readHeader(std::istream& rf) {
+    CscHeader header = CscHeader();
+    unsigned char lead[CSC_MAGIC_SIZE];
+    for (std::size_t i = 0; i < CSC_MAGIC_SIZE; i++)
+        lead[i] = readByte(rf);
+    if (std::memcmp(lead, CSC_MAGIC, CSC_MAGIC_SIZE) != 0) {
+        // version 1: the leading bytes are NUMBER_CHARS_TOTAL, little-endian
+        header.version = 1;
+        header.flags = 0;
+        header.originalLen = 0;
+        for (std::size_t i = 0; i < CSC_MAGIC_SIZE; i++)
+            header.originalLen |= (std::uint64_t) lead[i] << (i * CHAR_BIT);
+        readHeaderV1(rf, header);
+        return header;
+    }
+    header.version = readByte(rf);
+    if (header.version != CSC_FORMAT_VERSION)
+        throw std::runtime_error("Unsupported compressed format version "
+                                 + std::to_string(header.version));
+    header.flags = readByte(rf);
+    if ((header.flags & ~CSC_KNOWN_FLAGS) != 0
+            || ((header.flags & (CSC_FLAG_ARCHIVE | CSC_FLAG_STREAM))
+                && !(header.flags & CSC_FLAG_BLOCKS))
+            || ((header.flags & CSC_FLAG_STORED) && (header.flags & CSC_FLAG_BLOCKS))
+            || ((header.flags & CSC_FLAG_DICTIONARY)
+                && (header.flags & (CSC_FLAG_BLOCKS | CSC_FLAG_STORED))))
+        throw std::runtime_error("Unsupported compressed format flags");
+    header.originalLen = readVarint(rf);
+    unsigned extLen = readByte(rf);
+    for (unsigned i = 0; i < extLen; i++)
+        header.ext += (char) readByte(rf);
+    if ((header.flags & CSC_FLAG_CHECKSUM) && !(header.flags & CSC_FLAG_BLOCKS)) {
+        std::byte checksum[CHECKSUM_SIZE];
+        for (std::size_t i = 0; i < CHECKSUM_SIZE; i++)
+            checksum[i] = (std::byte) readByte(rf);
+        header.checksum = loadChecksum(checksum);
+    }
+    if (header.flags & CSC_FLAG_DICTIONARY) {
+        std::byte id[DICTIONARY_ID_SIZE];
+        for (std::size_t i = 0; i < DICTIONARY_ID_SIZE; i++)
+            id[i] = (std::byte) readByte(rf);
+        header.dictionaryId = loadLittleEndian32(id);
+        header.dictionaryTable = readByte(rf);
+    } else if ((header.flags & (CSC_FLAG_BLOCKS | CSC_FLAG_STORED)) == 0)
+        header.codes = canonicalCodes(unpackCodeLengths(rf, 256));
+    return header;
+}
@@ -0,0 +1,55 @@
+#include <histogram.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// 32 bit counts can't overflow within one slice
+constexpr std::size_t HISTOGRAM_SLICE_SIZE = (std::size_t) 1 << 30;
+static_assert(HISTOGRAM_TABLES == 4, "countSlice is unrolled for four tables");
+
+static void countSlice(const std::byte* data, const std::size_t n, std::uint64_t* freqs) {
+    std::uint32_t counts[HISTOGRAM_TABLES][256];
+    std::memset(counts, 0, sizeof(counts));
+    std::size_t i = 0;
+    // two 32 bit loads per step, each byte to its own table
+    for (; i + 8 <= n; i += 8) {
+        std::uint32_t a, b;
+        std::memcpy(&a, data + i, 4);
+        std::memcpy(&b, data + i + 4, 4);
+        counts[0][a & 0xFF]++;
+        counts[1][(a >> 8) & 0xFF]++;
+        counts[2][(a >> 16) & 0xFF]++;
+        counts[3][a >> 24]++;
+        counts[0][b & 0xFF]++;
+        counts[1][(b >> 8) & 0xFF]++;
+        counts[2][(b >> 16) & 0xFF]++;
+        counts[3][b >> 24]++;
+    }
+    for (; i < n; i++)
+        counts[0][(unsigned char) data[i]]++;
+    for (std::size_t sym = 0; sym < 256; sym++)
+        freqs[sym] += (std::uint64_t) counts[0][sym] + counts[1][sym] + counts[2][sym] + counts[3][sym];
+}
+
+void countBytes(const std::byte* data, const std::size_t n, std::uint64_t* freqs) {
+    for (std::size_t start = 0; start < n; start += HISTOGRAM_SLICE_SIZE)
+        countSlice(data + start, std::min(HISTOGRAM_SLICE_SIZE, n - start), freqs);
+}
+
+std::vector<std::uint64_t> byteHistogram(const std::byte* data, const std::size_t n) {
+    std::vector<std::uint64_t> freqs(256, 0);
+    countBytes(data, n, freqs.data());
+    return freqs;
+}
+
+double entropyBits(const std::vector<std::uint64_t>& freqs) {
+    std::uint64_t total = 0;
+    for (std::uint64_t f : freqs)
+        total += f;
+    double bits = 0;
+    for (std::uint64_t f : freqs) {
+        if (f > 0)
+            bits += f * std::log2((double) total / f);
+    }
+    return bits;
+}
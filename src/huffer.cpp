@@ -1,7 +1,22 @@
 #include <map>
 #include <huffer.hpp>
-#include <queue>
+#include <format.hpp>
+#include <blocks.hpp>
+#include <histogram.hpp>
+#include <archive.hpp>
+#include <threadpool.hpp>
+#include <stats.hpp>
+#include <checksum.hpp>
+#include <dictionary.hpp>
+#include <incremental.hpp>
+#include <pipeline.hpp>
+#include <split.hpp>
+#include <codec.hpp>
+#include <mutex>
+#include <set>
 #include <algorithm>
+#include <cstring>
+#include <limits>
 
 const std::string OS_SEP(1, std::filesystem::path::preferred_separator);
 
@@ -25,108 +40,56 @@ Compilation and System Reqs:
 -Filenames must be 255 characters or less (including the extension)
 -C++17 minimum (G++, MSVC, Clang), or C++20 minimum (any). */
 
-HuffNode::HuffNode(const std::byte character, const std::size_t frequency) {
-    data = character;
-    freq = frequency;
-    left = right = nullptr;
+// Counts every byte left in rf, a buffer at a time
+static std::vector<std::uint64_t> streamHistogram(std::istream& rf, std::size_t& counter) {
+    std::vector<std::uint64_t> freqs(256, 0);
+    std::vector<std::byte> buffer(IO_BUFFER_SIZE);
+    while (rf) {
+        rf.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+        countBytes(buffer.data(), (std::size_t) rf.gcount(), freqs.data());
+        counter += (std::size_t) rf.gcount();
+    }
+    return freqs;
 }
 
-HuffNode::HuffNode(HuffNode* leftChild, HuffNode* rightChild) {
-    left = leftChild;
-    right = rightChild;
-    freq = (left->freq) + (right->freq); 
+// Reads everything left in rf into memory, a buffer at a time
+static std::vector<std::byte> readAll(std::istream& rf) {
+    std::vector<std::byte> contents = std::vector<std::byte>();
+    while (rf) {
+        std::size_t size = contents.size();
+        contents.resize(size + IO_BUFFER_SIZE);
+        rf.read(reinterpret_cast<char*>(contents.data() + size), IO_BUFFER_SIZE);
+        contents.resize(size + (std::size_t) rf.gcount());
+    }
+    return contents;
 }
 
-void encodeFrequencies(
-    HuffNode* root, std::string code, 
-    std::map<std::byte, std::string>& output) {
-    if (root == nullptr)
-        return;
-    auto left = root->left, right = root->right;
-    if (left != nullptr)
-        encodeFrequencies(root->left, code + "0", output);
-    if (right != nullptr)
-        encodeFrequencies(root->right, code + "1", output);
-    if (left == nullptr && right == nullptr)
-        output[root->data] = code;
-}
-
-HuffNode* newTree(const std::map<std::byte, std::size_t>& freqTable) {
-    auto pq = std::priority_queue<HuffNode*, std::vector<HuffNode*>, Compare>();
-    for (auto it = freqTable.begin(); it != freqTable.end(); it++)
-        pq.push(new HuffNode(it->first,  it->second));
-    while (pq.size() > 1) {
-        auto lChild = topPop(pq);
-        auto rChild = topPop(pq);
-        pq.push(new HuffNode(lChild, rChild));
-    }
-    return pq.top();
-}
-
-HuffNode* remakeTree(const std::map<std::byte, std::string>& codeTable) {
-    HuffNode* root = new HuffNode((std::byte) 0, 0);
-    HuffNode* curNode = root;
-    for (auto it = codeTable.begin(); it != codeTable.end(); it++) {
-        HuffNode* curNode = root;
-        std::byte character = it->first;
-        std::string code = it->second;
-        for (int i = 0; i < code.length(); i++) {
-            if (code[i] == '0') {
-                if (curNode->left == nullptr) {
-                    curNode->left = new HuffNode((std::byte) 0, 0L);
-                }
-                curNode = curNode->left;
-            } else {
-                if (curNode->right == nullptr) {
-                    curNode->right = new HuffNode((std::byte) 0, 0L);
-                }
-                curNode = curNode->right;
-            }
-        }
-        curNode->data = character;
-    }
-    return root;
-}
-
-void delTree(HuffNode* root) {
-    if (root != nullptr) {
-        delTree(root->left);
-        delTree(root->right);
-        delete root;
+static std::map<std::byte, std::size_t> histogramToMap(const std::vector<std::uint64_t>& freqs) {
+    auto byteMap = std::map<std::byte, std::size_t>();
+    for (std::size_t i = 0; i < freqs.size(); i++) {
+        if (freqs[i] > 0)
+            byteMap[(std::byte) i] = freqs[i];
     }
+    return byteMap;
 }
 
 std::map<std::byte, std::size_t> getByteFrequencies(
     std::ifstream& rf, std::size_t& counter) {
-    auto byteMap = std::map<std::byte, std::size_t>();
     if(!rf) {
         throw std::invalid_argument("Can't open stream");
     }
-    char b = 0;
-    while(rf.get(b)) {
-        std::byte byteB = (std::byte) b;
-        byteMap[byteB] = byteMap[byteB] + 1;
-        counter++;
-    }
+    auto byteMap = histogramToMap(streamHistogram(rf, counter));
     rf.close();
     return byteMap;
     }
 
 std::map<std::byte, std::size_t> getByteFrequencies(
     const std::string inputFile, std::size_t& counter) {
-    auto byteMap = std::map<std::byte, std::size_t>();
     std::ifstream rf(inputFile, std::ios::in | std::ios::binary);
     if(!rf) {
         throw std::invalid_argument("Can't open file " + inputFile);
     }
-    char b = 0;
-    while (rf.get(b)) {
-        std::byte byteB = (std::byte) b;
-        byteMap[byteB] = byteMap[byteB] + 1;
-        counter++;
-    }
-    rf.close();
-    return byteMap;
+    return getByteFrequencies(rf, counter);
 }
 
 std::string padByteCode(const std::string code) {
@@ -152,23 +115,18 @@ std::vector<std::byte> stringToPaddedBytes(const std::string str) {
     return ret;
 }
 
-std::size_t fillBuffer(
-    std::byte* arr, const std::size_t arrLen, const std::string code) {
-    std::size_t bcount = 0;
-    for (std::size_t i = 0; bcount < arrLen; bcount++) {
-        unsigned char nextByte = 0;
-        for (std::size_t j = 0; j < CHAR_BIT; j++, i++) {
-            if (code[i] == '1')
-                nextByte |= (1 << (CHAR_BIT - 1 - j));
-        }
-        arr[bcount] = (std::byte) nextByte;
-    }
-    return bcount;
-}
-
-void encodeFrequencies(
-    HuffNode* root, std::map<std::byte, std::string>& codeTable) {
-    encodeFrequencies(root, "", codeTable);
+std::vector<std::uint8_t> huffmanCodeLengths(
+    const std::vector<std::uint64_t>& freqs, const unsigned maxLength, const bool exactLimit) {
+    if (freqs.size() > MAX_TREE_LEAVES)
+        return limitedCodeLengths(freqs, maxLength);
+    HuffTree tree;
+    tree.build(freqs.data(), freqs.size());
+    std::vector<std::uint8_t> lengths(freqs.size(), 0);
+    tree.codeLengths(lengths.data());
+    if (*std::max_element(lengths.begin(), lengths.end()) > maxLength)
+        lengths = exactLimit ? limitedCodeLengths(freqs, maxLength)
+                             : clampedCodeLengths(freqs, lengths, maxLength);
+    return lengths;
 }
 
 /*
@@ -212,22 +170,6 @@ std::vector<std::byte> genHeaderBytes(
     return ret;
 }
 
-HuffNode* tryGetLeaf(
-    HuffNode* curNode, const std::string encoding, std::size_t& moveCounter) {
-    std::size_t i = 0;
-    for (; i < encoding.length(); ++i) {
-        if (curNode == nullptr || isTreeLeaf(curNode)) {
-            break;
-        } else if (encoding[i] == '0') {
-            curNode = curNode->left;
-        } else {
-            curNode = curNode->right;
-        }
-        ++moveCounter;
-    }
-    return curNode;
-}
-
 void writeToFile(const std::vector<std::byte>& bytes,
                  const std::string outputFile, const bool append)  {
     const auto flags = std::ios::out | std::ios::binary;
@@ -235,64 +177,145 @@ void writeToFile(const std::vector<std::byte>& bytes,
     if(!wf) {
         throw std::invalid_argument("Can't open file " + outputFile);
     }
-    std::size_t sizeVal = bytes.size();
-    for (std::size_t i = 0; i < sizeVal; i++) {
-        wf.put((unsigned char) bytes.at(i));
+    wf.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    wf.close();
+}
+
+static void writeBlockedCompFile(
+        const std::string& inputFile, const std::string& outputFile,
+        const std::string& ext, const CscOptions& options) {
+    MappedFile input(inputFile);
+    std::ofstream wf(outputFile, std::ios::out | std::ios::binary);
+    if (!wf) {
+        throw std::invalid_argument("Can't compress to " + outputFile);
+    }
+    std::uint64_t total_chars = input.mapped() ? input.size() : std::filesystem::file_size(inputFile);
+    auto header = genBlockedHeaderBytes(ext, total_chars, checksumFlag(options));
+    wf.write(reinterpret_cast<const char*>(header.data()), header.size());
+    addStat(options.stats, &CscStats::files, 1);
+    addStat(options.stats, &CscStats::bytesOut, header.size());
+    if (input.mapped()) {
+        writeBlocks(input.data(), wf, header.size(), total_chars, options);
+    } else {
+        std::ifstream rf(inputFile, std::ios::in | std::ios::binary);
+        if (!rf) {
+            throw std::invalid_argument("Can't read " + inputFile);
+        }
+        writeBlocks(rf, wf, header.size(), total_chars, options);
     }
     wf.close();
 }
 
-void writeCompFile(
-        const std::string inputFile, 
-        const std::string outputFile, 
-        const bool verbose, 
-        const bool errOnExistingOutput) {
+// writeCompFile, with options already through levelOptions
+static void writeLeveledCompFile(
+        const std::string& inputFile,
+        const std::string& outputFile,
+        const bool verbose,
+        const bool errOnExistingOutput,
+        const CscOptions& options) {
     if (verbose)
-        std::cout << "Compressing " << inputFile << " to " << outputFile << " ...\n";
+        printMessage(std::cout, "Compressing " + inputFile + " to " + outputFile + " ...\n");
     if (std::filesystem::exists(outputFile) && errOnExistingOutput) {
-        std::cerr << ("Can't compress to existing file " + outputFile + "\n");
+        printMessage(std::cerr, "Can't compress to existing file " + outputFile + "\n");
         return;
     }
-    constexpr std::size_t bufferSize = IO_BUFFER_SIZE;
-    std::byte buffer[bufferSize];
     std::filesystem::path p = std::filesystem::path(inputFile);    
     std::string ext = p.extension().string();
-    std::size_t total_chars = 0;
-    std::map<std::byte, std::size_t> freqTable = getByteFrequencies(
-        inputFile, total_chars);
-    HuffNode* root = newTree(freqTable);
-    auto codeTable = std::map<std::byte, std::string>();
-    encodeFrequencies(root, codeTable);
-    auto header = genHeaderBytes(ext, total_chars, codeTable);
-    writeToFile(header, outputFile, false);
-    std::ofstream wf(outputFile, std::ios::out | std::ios::binary | std::ios::app);
-    std::ifstream rf(inputFile,  std::ios::in  | std::ios::binary );
-    std::string encoding = "";
-    std::string fullCode = "";
-    if (!rf) {
-        throw std::invalid_argument("Can't read " + inputFile);
+    if (std::filesystem::is_regular_file(p) && (needsBlocks(options)
+            || (options.blockSize > 0 && std::filesystem::file_size(p) > options.blockSize))) {
+        writeBlockedCompFile(inputFile, outputFile, ext, options);
+        return;
+    }
+    MappedFile input(inputFile);
+    std::vector<std::byte> contents = std::vector<std::byte>();
+    if (!input.mapped()) {
+        // a pipe can't be read twice, so keep what the counting pass reads
+        std::ifstream rf(inputFile, std::ios::in | std::ios::binary);
+        if (!rf) {
+            throw std::invalid_argument("Can't read " + inputFile);
+        }
+        contents = timePhase(options.stats, Phase::io, [&]() { return readAll(rf); });
     }
+    const std::byte* data = input.mapped() ? input.data() : contents.data();
+    const std::size_t total_chars = input.mapped() ? input.size() : contents.size();
+    std::ofstream wf(outputFile, std::ios::out | std::ios::binary);
     if (!wf) {
         throw std::invalid_argument("Can't compress to " + outputFile);
     }
-    for (char b; rf.get(b);) {
-        encoding += codeTable[(std::byte) b];
-        if (encoding.length() >= bufferSize * CHAR_BIT) {
-            fillBuffer(buffer, bufferSize, encoding);
-            for (std::size_t i = 0; i < bufferSize; i++) {
-                wf.put((unsigned char) buffer[i]);
-            }
-            encoding = encoding.substr(bufferSize * CHAR_BIT);
-        }
+    addStat(options.stats, &CscStats::files, 1);
+    // content whose distribution shifts partway codes smaller as blocks with a table each
+    std::vector<SplitPart> parts = std::vector<SplitPart>();
+    if (options.dictionary == nullptr && splitsBlocks(total_chars, options))
+        parts = findSplits(data, total_chars, options.stats);
+    if (parts.size() > 1) {
+        auto header = genBlockedHeaderBytes(ext, total_chars, checksumFlag(options));
+        wf.write(reinterpret_cast<const char*>(header.data()), header.size());
+        addStat(options.stats, &CscStats::bytesOut, header.size());
+        writeBlocks(data, wf, header.size(), parts, options);
+        wf.close();
+        return;
     }
-    if (encoding.length() > 0) {
-        std::vector<std::byte> remainingBytes = stringToPaddedBytes(encoding);
-        for (std::size_t i = 0; i < remainingBytes.size(); i++) {
-            wf.put((unsigned char) remainingBytes[i]);
-        }
+    addStat(options.stats, &CscStats::bytesIn, total_chars);
+    std::optional<std::uint32_t> checksum;
+    if (options.checksums)
+        checksum = timePhase(options.stats, Phase::checksum, [&]() {
+            return crc32c(0, data, total_chars);
+        });
+    auto writeStored = [&]() {
+        std::vector<std::byte> stored = genStoredHeaderBytes(ext, total_chars, checksum);
+        timePhase(options.stats, Phase::io, [&]() {
+            wf.write(reinterpret_cast<const char*>(stored.data()), stored.size());
+            wf.write(reinterpret_cast<const char*>(data), total_chars);
+            wf.close();
+        });
+        addStat(options.stats, &CscStats::bytesOut, stored.size() + total_chars);
+    };
+    const SingleStreamCode code = chooseSingleStreamCode(
+        data, total_chars, ext, checksum, options, parts.empty() ? nullptr : &parts[0].freqs);
+    if (code.stored)
+        return writeStored();
+    std::optional<EncodeTable> own;
+    const EncodeTable* table = code.dictionaryTable;
+    if (table == nullptr)
+        table = &own.emplace(canonicalCodes(code.lengths));
+    if (code.estimated) {
+        // code into memory, since the real size may still call for storing
+        std::vector<std::byte> out;
+        if (!encodeSingleStream(data, total_chars, code, *table, out, options.stats))
+            return writeStored();
+        timePhase(options.stats, Phase::io, [&]() {
+            wf.write(reinterpret_cast<const char*>(out.data()), out.size());
+            wf.close();
+        });
+        addStat(options.stats, &CscStats::bytesOut, out.size());
+        return;
     }
-    rf.close();
+    wf.write(reinterpret_cast<const char*>(code.header.data()), code.header.size());
+    timePhase(options.stats, Phase::encode, [&]() {
+        BitWriter bw(wf);
+        encodeBytes(*table, data, total_chars, bw);
+        bw.finish();
+    });
     wf.close();
+    if (options.stats != nullptr)
+        addStat(options.stats, &CscStats::bytesOut, std::filesystem::file_size(outputFile));
+}
+
+void writeCompFile(
+        const std::string inputFile, 
+        const std::string outputFile, 
+        const bool verbose, 
+        const bool errOnExistingOutput,
+        const CscOptions& options) {
+    writeLeveledCompFile(inputFile, outputFile, verbose, errOnExistingOutput, levelOptions(options));
+}
+
+void writeCompFile(
+        const std::string inputFile, 
+        const std::string outputFile, 
+        const bool verbose, 
+        const bool errOnExistingOutput) {
+    writeCompFile(inputFile, outputFile, verbose, errOnExistingOutput, CscOptions());
 }
 
 void writeCompFile(
@@ -300,90 +323,202 @@ void writeCompFile(
     writeCompFile(inputFile, outputFile, verbose, ERR_ON_OVERWRITES);
 }
 
+// The part of the original data options asks for, clamped to its length
+static void clampRange(const CscOptions& options, const std::uint64_t originalLen,
+                       std::uint64_t& rangeStart, std::uint64_t& rangeEnd) {
+    rangeStart = std::min(options.rangeStart, originalLen);
+    rangeEnd = rangeStart + std::min(options.rangeLength, originalLen - rangeStart);
+}
+
+/* Decodes a single-stream payload, writing original bytes [rangeStart, rangeEnd).
+The checksum can only be checked when the stream is decoded to its end.
+threaded gives the writes a thread of their own, for real output files. */
+static void decodeSingleStream(
+        const CscHeader& header, BitReader& br, std::ostream& wf,
+        const std::uint64_t rangeStart, const std::uint64_t rangeEnd, const bool threaded,
+        CscStats* stats) {
+    // a single stream has to be decoded from the start, even for a range
+    DecodeTable table(header.codes);
+    const bool check = (header.flags & CSC_FLAG_CHECKSUM) && rangeEnd == header.originalLen;
+    std::uint32_t crc = 0;
+    // writing each buffer overlaps with decoding the next
+    AsyncWriter writer(wf, stats, threaded);
+    for (std::uint64_t writeCount = 0; writeCount < rangeEnd;) {
+        std::size_t n = (std::size_t) std::min<std::uint64_t>(
+            IO_BUFFER_SIZE, rangeEnd - writeCount);
+        std::vector<std::byte> buffer(n);
+        timePhase(stats, Phase::decode, [&]() { decodeBytes(table, br, buffer.data(), n); });
+        if (check)
+            crc = timePhase(stats, Phase::checksum, [&]() { return crc32c(crc, buffer.data(), n); });
+        if (writeCount + n > rangeStart) {
+            std::size_t skip = (std::size_t) (std::max(writeCount, rangeStart) - writeCount);
+            buffer.erase(buffer.begin(), buffer.begin() + skip);
+            writer.write(std::move(buffer));
+        }
+        writeCount += n;
+    }
+    writer.finish();
+    if (br.overrun())
+        throw std::runtime_error("Compressed data is truncated");
+    if (check)
+        verifyChecksum(crc, header.checksum);
+}
+
+/* Copies original bytes [rangeStart, rangeEnd) of a stored payload starting
+at rf, checking the checksum if the copy reaches the end of the payload. */
+static void copyStoredStream(
+        const CscHeader& header, std::istream& rf, std::ostream& wf,
+        const std::uint64_t rangeStart, const std::uint64_t rangeEnd) {
+    const bool check = (header.flags & CSC_FLAG_CHECKSUM) && rangeEnd == header.originalLen;
+    std::uint32_t crc = 0;
+    std::vector<char> buffer(IO_BUFFER_SIZE);
+    for (std::uint64_t readCount = 0; readCount < rangeEnd;) {
+        std::size_t n = (std::size_t) std::min<std::uint64_t>(buffer.size(), rangeEnd - readCount);
+        if (!rf.read(buffer.data(), n))
+            throw std::runtime_error("Compressed data is truncated");
+        if (check)
+            crc = crc32c(crc, reinterpret_cast<const std::byte*>(buffer.data()), n);
+        if (readCount + n > rangeStart) {
+            std::size_t skip = (std::size_t) (std::max(readCount, rangeStart) - readCount);
+            wf.write(buffer.data() + skip, n - skip);
+        }
+        readCount += n;
+    }
+    if (check)
+        verifyChecksum(crc, header.checksum);
+}
+
+// Output stream buffer that drops everything, for decoding only to check the data
+class DiscardStreamBuf : public std::streambuf {
+    protected:
+        int_type overflow(int_type c) override {
+            return traits_type::not_eof(c);
+        }
+
+        std::streamsize xsputn(const char*, std::streamsize n) override {
+            return n;
+        }
+};
+
+// Decodes all of comp, whose header was just read from rf, and checks it
+static void testCompFile(
+        const std::string& comp, std::ifstream& rf, const CscHeader& header,
+        const bool verbose, const CscOptions& options) {
+    if (verbose)
+        printMessage(std::cout, "Testing " + comp + " ...\n");
+    addStat(options.stats, &CscStats::files, 1);
+    if (options.stats != nullptr)
+        addStat(options.stats, &CscStats::bytesIn, std::filesystem::file_size(comp));
+    if (header.flags & CSC_FLAG_ARCHIVE) {
+        rf.close();
+        testArchive(comp, options);
+    } else if (header.flags & CSC_FLAG_BLOCKS) {
+        std::uint64_t payloadOffset = (std::uint64_t) rf.tellg();
+        rf.close();
+        PositionedFile in(comp, false);
+        testBlocks(in, readBlockIndex(in, header, payloadOffset), options);
+    } else {
+        DiscardStreamBuf discard;
+        std::ostream wf(&discard);
+        if (header.flags & CSC_FLAG_STORED) {
+            copyStoredStream(header, rf, wf, 0, header.originalLen);
+        } else {
+            BitReader br(rf);
+            decodeSingleStream(header, br, wf, 0, header.originalLen, false, options.stats);
+        }
+    }
+    if (verbose)
+        printMessage(std::cout, comp + ((header.flags & CSC_FLAG_CHECKSUM)
+            ? ": OK\n" : ": decodes, but has no checksums to verify\n"));
+}
+
 void writeDecompFile(const std::string comp, 
                      const std::string decodeFilename,
                      const bool verbose,
-                     const bool errorOnExistingOutput) {
+                     const bool errorOnExistingOutput,
+                     const CscOptions& options) {
     std::ifstream rf(comp, std::ios::in  | std::ios::binary);
     if (!rf) {
         throw std::invalid_argument("Can't read " + comp);
     }
-    constexpr std::size_t bufferSize = IO_BUFFER_SIZE;
     std::string outputFile;
-    char b;
-    std::size_t originalLen;
-    std::byte originalLenBytes[sizeof(std::size_t)];
-    std::byte numUniqueBytes[sizeof(unsigned short)];
-    unsigned short extLen;
-    unsigned short numUnique;
-    std::string ext = "";
-    std::map<std::byte, std::string> codeTable = std::map<std::byte, std::string>();
-    rf.read(reinterpret_cast<char*>(originalLenBytes), sizeof(std::size_t));
-    if constexpr(CSC_BIG_ENDIAN) {
-        std::reverse(originalLenBytes, originalLenBytes + sizeof(std::size_t));
-    }
-    memcpy(&originalLen, originalLenBytes, sizeof(std::size_t));
-    rf.get(b);
-    extLen = (unsigned short) b;
-    for (int i = 0; i < extLen; i++) {
-        rf.get(b);
-        ext += b;
-    }
-    rf.read(reinterpret_cast<char*>(numUniqueBytes), sizeof(unsigned short));
-    if constexpr(CSC_BIG_ENDIAN) {
-        std::reverse(numUniqueBytes, numUniqueBytes + sizeof(unsigned short));
-    }
-    memcpy(&numUnique, numUniqueBytes, sizeof(unsigned short));
+    CscHeader header = readHeader(rf);
+    useDictionary(header, options.dictionary);
+    if (options.testOnly) {
+        testCompFile(comp, rf, header, verbose, options);
+        return;
+    }
+    if (header.flags & CSC_FLAG_ARCHIVE) {
+        rf.close();
+        extractArchive(comp, decodeFilename, verbose, options);
+        return;
+    }
+    std::string ext = header.ext;
+    std::uint64_t rangeStart, rangeEnd;
+    clampRange(options, header.originalLen, rangeStart, rangeEnd);
     if (!std::filesystem::path(decodeFilename).has_extension()) {
         outputFile = decodeFilename + ext;
     } else {
         outputFile = decodeFilename;
     }
     if (verbose)
-        std::cout << "Decompressing " << comp << " to " << outputFile << " ...\n";
+        printMessage(std::cout, "Decompressing " + comp + " to " + outputFile + " ...\n");
     if (std::filesystem::exists(outputFile) && errorOnExistingOutput) {
-        std::cerr << ("Can't decompress to existing file " + outputFile + "\n");
+        printMessage(std::cerr, "Can't decompress to existing file " + outputFile + "\n");
+        return;
+    }
+    addStat(options.stats, &CscStats::files, 1);
+    if (options.stats != nullptr)
+        addStat(options.stats, &CscStats::bytesIn, std::filesystem::file_size(comp));
+    if (header.flags & CSC_FLAG_BLOCKS) {
+        std::uint64_t payloadOffset = (std::uint64_t) rf.tellg();
+        rf.close();
+        PositionedFile in(comp, false);
+        std::vector<BlockInfo> blocks = readBlockIndex(in, header, payloadOffset);
+        if (header.flags & CSC_FLAG_STREAM) {
+            header.originalLen = blocks.empty() ? 0 : blocks.back().rawOffset + blocks.back().rawSize;
+            clampRange(options, header.originalLen, rangeStart, rangeEnd);
+        }
+        decodeBlocksParallel(in, blocks, outputFile, rangeStart, rangeEnd, options);
+        addStat(options.stats, &CscStats::bytesOut, rangeEnd - rangeStart);
         return;
     }
+    addStat(options.stats, &CscStats::bytesOut, rangeEnd - rangeStart);
     std::ofstream wf(outputFile, std::ios::out | std::ios::binary | std::ios::app);
     if (!wf) {
         throw std::invalid_argument("Can't decompress to " + outputFile);
     }
-    for (int i = 0; i < numUnique; i++) {
-        rf.get(b);
-        std::byte character = (std::byte) b;
-        rf.get(b);
-        unsigned short codeLen = (unsigned short) b;
-        unsigned short codeByteLen = minByteCount(codeLen);
-        std::string paddedCode = "";
-        for (int i = 0; i < codeByteLen; i++) {
-            rf.get(b);
-            paddedCode += std::bitset<CHAR_BIT>(b).to_string();
-        }
-        codeTable[character] = paddedCode.substr(0, codeLen);
-    }
-    HuffNode* root = remakeTree(codeTable);
-    HuffNode* curNode = root;
-    std::string encoding = "";
-    std::size_t writeCount = 0;
-    while (writeCount < originalLen) {
-        for (int i = 0; (i < IO_BUFFER_SIZE * CHAR_BIT) && rf.get(b); i++) {
-            encoding += std::bitset<CHAR_BIT>(b).to_string();
-        }
-        while (writeCount < originalLen && !encoding.empty()) {
-            std::size_t moveCount = 0;
-            curNode = tryGetLeaf(curNode, encoding, moveCount);
-            encoding = encoding.substr(moveCount);
-            if (isTreeLeaf(curNode)) {
-                wf.put((unsigned char)(curNode->data));
-                writeCount++;
-                curNode = root;
-            }
+    std::uint64_t payloadOffset = (std::uint64_t) rf.tellg();
+    MappedFile input(comp);
+    if (header.flags & CSC_FLAG_STORED) {
+        PhaseTimer timer(options.stats, Phase::io);
+        if (!input.mapped()) {
+            copyStoredStream(header, rf, wf, rangeStart, rangeEnd);
+        } else if (input.size() - payloadOffset < header.originalLen) {
+            throw std::runtime_error("Compressed data is truncated");
+        } else {
+            if (header.flags & CSC_FLAG_CHECKSUM)
+                verifyChecksum(crc32c(0, input.data() + payloadOffset, header.originalLen),
+                               header.checksum);
+            wf.write(reinterpret_cast<const char*>(input.data() + payloadOffset + rangeStart),
+                     rangeEnd - rangeStart);
         }
+        return;
     }
+    std::unique_ptr<BitReader> reader = input.mapped() && input.size() >= payloadOffset
+        ? std::make_unique<BitReader>(input.data() + payloadOffset, input.size() - payloadOffset)
+        : std::make_unique<BitReader>(rf);
+    decodeSingleStream(
+        header, *reader, wf, rangeStart, rangeEnd, threadsStreams(options), options.stats);
     rf.close();
     wf.close();
-    delTree(root);
+}
+
+void writeDecompFile(const std::string comp, 
+                     const std::string decodeFilename,
+                     const bool verbose,
+                     const bool errorOnExistingOutput) {
+    writeDecompFile(comp, decodeFilename, verbose, errorOnExistingOutput, CscOptions());
 }
 
 void writeDecompFile(
@@ -391,12 +526,104 @@ void writeDecompFile(
     writeDecompFile(comp, decodeFilename, verbose, ERR_ON_OVERWRITES);
 }
 
+void compressStream(
+        std::istream& rf, std::ostream& wf, const std::string& ext, const CscOptions& requested) {
+    const CscOptions options = levelOptions(requested);
+    auto header = genBlockedHeaderBytes(ext, 0, CSC_FLAG_STREAM | checksumFlag(options));
+    wf.write(reinterpret_cast<const char*>(header.data()), header.size());
+    wf.flush();
+    addStat(options.stats, &CscStats::files, 1);
+    addStat(options.stats, &CscStats::bytesOut, header.size());
+    writeBlocks(rf, wf, header.size(), UNKNOWN_LENGTH, options);
+    if (!wf)
+        throw std::runtime_error("Can't write the compressed output");
+}
+
+void decompressStream(std::istream& rf, std::ostream& wf, const CscOptions& options) {
+    CscHeader header = readHeader(rf);
+    useDictionary(header, options.dictionary);
+    addStat(options.stats, &CscStats::files, 1);
+    if (header.flags & CSC_FLAG_ARCHIVE)
+        throw std::invalid_argument("Archives can't be extracted from a stream");
+    if (header.flags & CSC_FLAG_BLOCKS) {
+        if (options.rangeStart != 0 || options.rangeLength != WHOLE_FILE)
+            throw std::invalid_argument("Ranges of blocked data need a seekable compressed file");
+        addStat(options.stats, &CscStats::bytesOut, readBlocks(rf, wf, header, options));
+        // let the writer finish sending the block index
+        rf.ignore(std::numeric_limits<std::streamsize>::max());
+    } else {
+        std::uint64_t rangeStart, rangeEnd;
+        clampRange(options, header.originalLen, rangeStart, rangeEnd);
+        addStat(options.stats, &CscStats::bytesOut, rangeEnd - rangeStart);
+        if (header.flags & CSC_FLAG_STORED) {
+            PhaseTimer timer(options.stats, Phase::io);
+            copyStoredStream(header, rf, wf, rangeStart, rangeEnd);
+        } else {
+            BitReader br(rf);
+            decodeSingleStream(
+                header, br, wf, rangeStart, rangeEnd, threadsStreams(options), options.stats);
+        }
+    }
+    wf.flush();
+    if (!wf)
+        throw std::runtime_error("Can't write the decompressed output");
+}
+
+void processStream(
+        const std::string& inputFile,
+        const std::string& outputFile,
+        const bool decode,
+        const CscOptions& options) {
+    std::ifstream inFile;
+    std::ofstream outFile;
+    std::istream* rf = &std::cin;
+    std::ostream* wf = &std::cout;
+    DiscardStreamBuf discard;
+    std::ostream discardStream(&discard);
+    if (inputFile != STDIO_PATH) {
+        inFile.open(inputFile, std::ios::in | std::ios::binary);
+        if (!inFile)
+            throw std::invalid_argument("Can't read " + inputFile);
+        rf = &inFile;
+    }
+    if (decode && options.testOnly) {
+        wf = &discardStream;
+    } else if (outputFile != STDIO_PATH) {
+        std::string outPath = decode ? outputFile
+            : std::filesystem::path(outputFile).replace_extension(COMPRESSION_EXT).string();
+        if (std::filesystem::exists(outPath) && ERR_ON_OVERWRITES) {
+            printMessage(std::cerr, "Can't write to existing file " + outPath + "\n");
+            return;
+        }
+        createDirsIfNeeded(outPath, false);
+        outFile.open(outPath, std::ios::out | std::ios::binary);
+        if (!outFile)
+            throw std::invalid_argument("Can't write to " + outPath);
+        wf = &outFile;
+    }
+    if (decode) {
+        if (inputFile != STDIO_PATH && options.stats != nullptr)
+            addStat(options.stats, &CscStats::bytesIn, std::filesystem::file_size(inputFile));
+        decompressStream(*rf, *wf, options);
+    } else {
+        std::string ext = (inputFile == STDIO_PATH) ? ""
+            : std::filesystem::path(inputFile).extension().string();
+        compressStream(*rf, *wf, ext, options);
+    }
+}
+
+void printMessage(std::ostream& os, const std::string& message) {
+    static std::mutex printLock;
+    std::lock_guard<std::mutex> guard(printLock);
+    os << message << std::flush;
+}
+
 void createDirsIfNeeded(const std::string& filePath, const bool verbose) {
     std::filesystem::path fiPath(filePath);
     std::filesystem::path dirPath = fiPath.parent_path();
     if (!dirPath.empty() && dirPath != std::filesystem::current_path() 
             && std::filesystem::create_directories(dirPath) && verbose) {
-        std::cout << "Successfully created directories: " << dirPath << "\n";
+        printMessage(std::cout, "Successfully created directories: \"" + dirPath.string() + "\"\n");
     }
 }
 
@@ -404,7 +631,8 @@ void processFile(
         const std::string& inputFile, 
         const std::string& outputFile, 
         const bool decode, 
-        const bool verbose) {
+        const bool verbose,
+        const CscOptions& options) {
     std::string outPath = outputFile;
     std::string inPath = inputFile;
     bool dirWithSameName = std::filesystem::is_directory(outputFile);
@@ -413,49 +641,195 @@ void processFile(
     else if (decode && !dirWithSameName) {
         inPath = std::filesystem::path(inputFile).replace_extension(COMPRESSION_EXT).string();
     }
+    if (decode && options.testOnly) {
+        writeDecompFile(inPath, outPath, verbose, false, options);
+        return;
+    }
     if (std::filesystem::exists(outPath) && !dirWithSameName) {
         if (verbose)
-            std::cout << outputFile << " already exists -- skipping\n";
+            printMessage(std::cout, outputFile + " already exists -- skipping\n");
         return;
     }
     createDirsIfNeeded(outPath, verbose);
     if (decode) {
-        writeDecompFile(inPath, outPath, verbose);
+        writeDecompFile(inPath, outPath, verbose, ERR_ON_OVERWRITES, options);
     } else {
-        writeCompFile(inPath, outPath, verbose);
+        writeCompFile(inPath, outPath, verbose, ERR_ON_OVERWRITES, options);
     }
 }
 
+void processFile(
+        const std::string& inputFile, 
+        const std::string& outputFile, 
+        const bool decode, 
+        const bool verbose) {
+    processFile(inputFile, outputFile, decode, verbose, CscOptions());
+}
+
 void processFile(
         const std::string& filePath, const std::string& outputFile, const bool decode) {
     processFile(filePath, outputFile, decode, false);
 }
 
-void processDirectory(
+bool tryProcessFile(
+        const std::string& filePath, 
+        const std::string& outputFile, 
+        const bool decode,
+        const bool verbose,
+        const CscOptions& options) {
+    try {
+        processFile(filePath, outputFile, decode, verbose, options);
+        return true;
+    } catch (const std::exception& e) {
+        printMessage(std::cerr, "Error processing " + filePath + ": " + e.what() + "\n");
+        return false;
+    }
+}
+
+/* Compresses the files of a directory whose size and mtime, or failing
+those their contents, differ from the manifest in outputDir, and deletes the
+outputs of inputs that are gone. Returns the number of failures. */
+static std::size_t compressChangedFiles(
+        const std::vector<std::pair<std::uintmax_t, std::filesystem::path>>& files,
+        const std::string& outputDir, const bool verbose, const CscOptions& options) {
+    const std::string manifestPath = outputDir + OS_SEP + INCREMENTAL_MANIFEST_NAME;
+    const std::uint32_t fingerprint = optionsFingerprint(options);
+    const SourceRecords previous = readIncrementalManifest(manifestPath, fingerprint);
+    SourceRecords records;
+    // the whole name, as a.txt and a.json would both become a.csc without their extensions
+    auto outputOf = [&](const std::string& name) {
+        return outputDir + OS_SEP + name + COMPRESSION_EXT;
+    };
+    auto pending = std::vector<std::pair<std::string, std::future<std::optional<SourceRecord>>>>();
+    for (const auto& file : files) {
+        const std::string name = file.second.filename().string();
+        const std::string input = file.second.string();
+        const std::string output = outputOf(name);
+        auto old = previous.find(name);
+        const bool haveOld = old != previous.end() && std::filesystem::exists(output);
+        SourceRecord now;
+        try {
+            now = statSource(input);
+        } catch (const std::exception& e) {
+            printMessage(std::cerr, "Error processing " + input + ": " + e.what() + "\n");
+            continue;
+        }
+        if (haveOld && old->second.size == now.size && old->second.mtime == now.mtime) {
+            records[name] = old->second;
+            continue;
+        }
+        pending.push_back({name, options.pool->submit([=]() -> std::optional<SourceRecord> {
+            SourceRecord record = now;
+            try {
+                // the stat came first, so a change while compressing shows up next run
+                record.hash = hashFile(input);
+                if (haveOld && old->second.size == record.size && old->second.hash == record.hash) {
+                    if (verbose)
+                        printMessage(std::cout, input + " unchanged -- skipping\n");
+                    return record;
+                }
+                std::filesystem::remove(output);
+            } catch (const std::exception& e) {
+                printMessage(std::cerr, "Error processing " + input + ": " + e.what() + "\n");
+                return std::nullopt;
+            }
+            if (!tryProcessFile(input, output, false, verbose, options))
+                return std::nullopt;
+            return record;
+        })});
+    }
+    std::size_t failures = 0;
+    for (auto& [name, result] : pending) {
+        std::optional<SourceRecord> record = options.pool->wait(result);
+        if (record)
+            records[name] = *record;
+        else
+            failures++;
+    }
+    std::set<std::string> current;
+    for (const auto& file : files)
+        current.insert(outputOf(file.second.filename().string()));
+    for (const auto& [name, record] : previous) {
+        // the input is gone, so its output is stale
+        const std::string output = outputOf(name);
+        if (current.count(output) > 0)
+            continue;
+        try {
+            if (std::filesystem::remove(output) && verbose)
+                printMessage(std::cout, "Removed stale " + output + "\n");
+        } catch (const std::exception& e) {
+            // the manifest still gets written, so the run's work isn't lost
+            printMessage(std::cerr, "Can't remove stale " + output + ": " + e.what() + "\n");
+            failures++;
+        }
+    }
+    writeIncrementalManifest(manifestPath, records, fingerprint);
+    return failures;
+}
+
+std::size_t processDirectory(
         const std::string& dirPath, 
         const std::string& outputDir, 
         const bool decode, 
-        const bool verbose) {
+        const bool verbose,
+        const CscOptions& options) {
+    auto files = std::vector<std::pair<std::uintmax_t, std::filesystem::path>>();
     for (const auto& entry : std::filesystem::directory_iterator(dirPath)) {
         if (!entry.is_regular_file() 
             || (decode  && entry.path().extension() != COMPRESSION_EXT)
             || (!decode && entry.path().extension() == COMPRESSION_EXT))
             continue;
-        std::string replExt = decode ? "" : COMPRESSION_EXT;
-        std::string output = std::filesystem::path(
-            entry.path().string()).filename().replace_extension(replExt).string();
-        if (!std::filesystem::exists(outputDir)) {
-            // Attempt to create the directory
-            if (!std::filesystem::create_directories(outputDir)) {
-                throw std::runtime_error("Failed to create directory: " + outputDir);
-            }
+        files.push_back({entry.file_size(), entry.path()});
+    }
+    const bool incremental = options.incremental && !decode;
+    // an incremental run with no inputs left still has outputs to delete
+    if (files.empty() && !(incremental && std::filesystem::exists(outputDir)))
+        return 0;
+    if (!(decode && options.testOnly) && !std::filesystem::exists(outputDir)) {
+        // Attempt to create the directory
+        if (!std::filesystem::create_directories(outputDir)) {
+            throw std::runtime_error("Failed to create directory: " + outputDir);
         }
-        processFile(entry.path().string(), 
-                    outputDir + OS_SEP + output, decode, verbose);
     }
+    // largest first, so a big file doesn't start last and hold up the batch
+    std::stable_sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+        return a.first > b.first;
+    });
+    CscOptions taskOptions = options;
+    std::unique_ptr<ThreadPool> ownPool;
+    if (taskOptions.pool == nullptr) {
+        ownPool = std::make_unique<ThreadPool>(options.threads);
+        taskOptions.pool = ownPool.get();
+    }
+    if (incremental)
+        return compressChangedFiles(files, outputDir, verbose, taskOptions);
+    std::string replExt = decode ? "" : COMPRESSION_EXT;
+    auto results = std::vector<std::future<bool>>();
+    for (const auto& file : files) {
+        std::string input = file.second.string();
+        std::string output = outputDir + OS_SEP
+            + std::filesystem::path(file.second).filename().replace_extension(replExt).string();
+        results.push_back(taskOptions.pool->submit([=]() {
+            return tryProcessFile(input, output, decode, verbose, taskOptions);
+        }));
+    }
+    std::size_t failures = 0;
+    for (std::future<bool>& result : results) {
+        if (!taskOptions.pool->wait(result))
+            failures++;
+    }
+    return failures;
+}
+
+std::size_t processDirectory(
+        const std::string& dirPath, 
+        const std::string& outputDir, 
+        const bool decode, 
+        const bool verbose) {
+    return processDirectory(dirPath, outputDir, decode, verbose, CscOptions());
 }
 
-void processDirectory(
+std::size_t processDirectory(
         const std::string& dirPath, const std::string& outputDir, const bool decode) {
-    processDirectory(dirPath, outputDir, decode, false);
+    return processDirectory(dirPath, outputDir, decode, false);
 }
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include <hufftree.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+void HuffTree::build(const std::uint64_t* freqs, const std::size_t alphabetSize) {
+    if (alphabetSize > MAX_TREE_LEAVES)
+        throw std::invalid_argument("Too many symbols for a Huffman tree");
+    numNodes = 0;
+    for (std::size_t sym = 0; sym < alphabetSize; sym++) {
+        if (freqs[sym] > 0)
+            nodes[numNodes++] = {freqs[sym], TREE_NO_CHILD, TREE_NO_CHILD, (std::uint16_t) sym};
+    }
+    numLeaves = numNodes;
+    std::sort(nodes.begin(), nodes.begin() + numLeaves, [](const TreeNode& a, const TreeNode& b) {
+        return a.freq != b.freq ? a.freq < b.freq : a.symbol < b.symbol;
+    });
+    // merged nodes come out in increasing order of frequency, so the two
+    // smallest are always at the front of either the leaves or the merged nodes
+    std::size_t nextLeaf = 0;
+    std::size_t nextMerged = numLeaves;
+    auto takeSmallest = [&]() {
+        if (nextLeaf < numLeaves
+                && (nextMerged == numNodes || nodes[nextLeaf].freq <= nodes[nextMerged].freq))
+            return (std::int16_t) nextLeaf++;
+        return (std::int16_t) nextMerged++;
+    };
+    while ((numLeaves - nextLeaf) + (numNodes - nextMerged) > 1) {
+        std::int16_t left = takeSmallest();
+        std::int16_t right = takeSmallest();
+        nodes[numNodes++] = {nodes[left].freq + nodes[right].freq, left, right, 0};
+    }
+}
+
+void HuffTree::codeLengths(std::uint8_t* lengths) const {
+    if (numNodes == 0)
+        return;
+    std::array<std::uint8_t, MAX_TREE_NODES> depth;
+    depth[numNodes - 1] = 0;
+    // parents come after their children, so walk down from the root
+    for (std::size_t i = numNodes; i-- > numLeaves;) {
+        depth[nodes[i].left] = depth[i] + 1;
+        depth[nodes[i].right] = depth[i] + 1;
+    }
+    for (std::size_t i = 0; i < numLeaves; i++)
+        lengths[nodes[i].symbol] = std::max(depth[i], (std::uint8_t) 1);
+}
+
+std::size_t HuffTree::size() const {
+    return numNodes;
+}
+
+std::int16_t HuffTree::root() const {
+    return numNodes == 0 ? TREE_NO_CHILD : (std::int16_t) (numNodes - 1);
+}
+
+const TreeNode& HuffTree::node(const std::size_t i) const {
+    return nodes[i];
+}
@@ -0,0 +1,121 @@
+#include <incremental.hpp>
+#include <checksum.hpp>
+#include <dictionary.hpp>
+#include <fileio.hpp>
+#include <format.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+std::uint32_t optionsFingerprint(const CscOptions& options) {
+    std::vector<std::byte> settings = std::vector<std::byte>();
+    settings.push_back((std::byte) CSC_FORMAT_VERSION);
+    putVarint(settings, options.level);
+    putVarint(settings, options.maxCodeLength);
+    putVarint(settings, options.blockSize);
+    putVarint(settings, options.interleave);
+    putVarint(settings, options.contextClusters);
+    putVarint(settings, options.checksums);
+    putVarint(settings, options.lzLevel);
+    putVarint(settings, options.dictionary != nullptr ? options.dictionary->id : 0);
+    putVarint(settings, options.dictionaryTable);
+    return crc32c(0, settings.data(), settings.size());
+}
+
+SourceRecord statSource(const std::string& path) {
+    return {std::filesystem::file_size(path),
+            (std::int64_t) std::filesystem::last_write_time(path).time_since_epoch().count(), 0};
+}
+
+std::uint32_t hashFile(const std::string& path) {
+    MappedFile input(path);
+    if (input.mapped())
+        return crc32c(0, input.data(), input.size());
+    std::ifstream rf(path, std::ios::in | std::ios::binary);
+    if (!rf)
+        throw std::invalid_argument("Can't read " + path);
+    std::uint32_t crc = 0;
+    std::vector<char> buffer(IO_BUFFER_SIZE);
+    while (rf.read(buffer.data(), buffer.size()) || rf.gcount() > 0)
+        crc = crc32c(crc, reinterpret_cast<const std::byte*>(buffer.data()), (std::size_t) rf.gcount());
+    return crc;
+}
+
+static SourceRecords parseIncrementalManifest(
+        const std::byte* data, const std::size_t n, const std::uint32_t fingerprint) {
+    SourceRecords records;
+    if (n < INCREMENTAL_MAGIC_SIZE + CHECKSUM_SIZE
+            || std::memcmp(data, INCREMENTAL_MAGIC, INCREMENTAL_MAGIC_SIZE) != 0
+            || crc32c(0, data, n - CHECKSUM_SIZE) != loadChecksum(data + n - CHECKSUM_SIZE))
+        return records;
+    ByteCursor cur(data, n - CHECKSUM_SIZE);
+    cur.take(INCREMENTAL_MAGIC_SIZE);
+    if (cur.next() != INCREMENTAL_VERSION || loadChecksum(cur.take(CHECKSUM_SIZE)) != fingerprint)
+        return records;
+    const std::uint64_t numEntries = readVarint(cur);
+    for (std::uint64_t i = 0; i < numEntries; i++) {
+        const std::uint64_t nameLength = readVarint(cur);
+        if (nameLength > cur.remaining())
+            throw std::runtime_error("Malformed incremental manifest");
+        const char* name = reinterpret_cast<const char*>(cur.take((std::size_t) nameLength));
+        SourceRecord record;
+        record.size = readVarint(cur);
+        std::uint64_t mtime = 0;
+        const std::byte* mtimeBytes = cur.take(8);
+        for (int b = 0; b < 8; b++)
+            mtime |= (std::uint64_t) mtimeBytes[b] << (b * 8);
+        record.mtime = (std::int64_t) mtime;
+        record.hash = loadChecksum(cur.take(CHECKSUM_SIZE));
+        records[std::string(name, (std::size_t) nameLength)] = record;
+    }
+    return records;
+}
+
+SourceRecords readIncrementalManifest(const std::string& path, const std::uint32_t fingerprint) {
+    std::ifstream rf(path, std::ios::in | std::ios::binary);
+    if (!rf)
+        return SourceRecords();
+    std::vector<char> bytes((std::istreambuf_iterator<char>(rf)), std::istreambuf_iterator<char>());
+    try {
+        return parseIncrementalManifest(
+            reinterpret_cast<const std::byte*>(bytes.data()), bytes.size(), fingerprint);
+    } catch (const std::runtime_error&) {
+        return SourceRecords();
+    }
+}
+
+void writeIncrementalManifest(
+        const std::string& path, const SourceRecords& records, const std::uint32_t fingerprint) {
+    std::vector<std::byte> out = std::vector<std::byte>();
+    // +MAGIC
+    for (std::size_t i = 0; i < INCREMENTAL_MAGIC_SIZE; i++)
+        out.push_back((std::byte) INCREMENTAL_MAGIC[i]);
+    // +VERSION
+    out.push_back((std::byte) INCREMENTAL_VERSION);
+    // +OPTIONS
+    putChecksum(out, fingerprint);
+    // +NUM_ENTRIES
+    putVarint(out, records.size());
+    for (const auto& [name, record] : records) {
+        // +NAME_LENGTH, +NAME
+        putVarint(out, name.size());
+        for (char c : name)
+            out.push_back((std::byte) c);
+        // +SIZE
+        putVarint(out, record.size);
+        // +MTIME
+        putLittleEndian64(out, (std::uint64_t) record.mtime);
+        // +HASH
+        putChecksum(out, record.hash);
+    }
+    // +CHECKSUM
+    putChecksum(out, crc32c(0, out.data(), out.size()));
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream wf(temporary, std::ios::out | std::ios::binary);
+        if (!wf || !wf.write(reinterpret_cast<const char*>(out.data()), out.size()))
+            throw std::invalid_argument("Can't write " + temporary);
+    }
+    std::filesystem::rename(temporary, path);
+}
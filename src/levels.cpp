@@ -0,0 +1,52 @@
+#include <levels.hpp>
+#include <context.hpp>
+#include <histogram.hpp>
+#include <lz.hpp>
+
+CscOptions levelOptions(const CscOptions& options) {
+    CscOptions leveled = options;
+    // dictionary tables only code single streams, which these block types would rule out
+    if (options.dictionary != nullptr)
+        return leveled;
+    if (options.level >= MIN_CONTEXT_TRYING_LEVEL && leveled.contextClusters == 0)
+        leveled.contextClusters = DEFAULT_CONTEXT_CLUSTERS;
+    if (options.level >= MIN_LZ_TRYING_LEVEL && leveled.lzLevel == 0)
+        leveled.lzLevel = options.level == MAX_LEVEL ? MAX_LZ_LEVEL : DEFAULT_LZ_LEVEL;
+    return leveled;
+}
+
+std::vector<std::uint64_t> levelHistogram(
+        const std::byte* data, const std::size_t n, const CscOptions& options) {
+    if (!sampledHistogram(n, options))
+        return byteHistogram(data, n);
+    // every 16th stretch at level 1, every 8th at 2 and every 4th at 3
+    const std::size_t step = HISTOGRAM_SAMPLE_STRETCH << (MAX_FAST_LEVEL + 2 - options.level);
+    std::vector<std::uint64_t> freqs(256, 0);
+    std::size_t sampled = 0;
+    for (std::size_t start = 0; start < n; start += step) {
+        const std::size_t len = std::min(HISTOGRAM_SAMPLE_STRETCH, n - start);
+        countBytes(data + start, len, freqs.data());
+        sampled += len;
+    }
+    const double scale = (double) n / sampled;
+    for (std::uint64_t& f : freqs)
+        f = f > 0 ? (std::uint64_t) (f * scale + 0.5) : 1;
+    return freqs;
+}
+
+std::vector<std::uint8_t> levelCodeLengths(
+        const std::vector<std::uint64_t>& freqs, const CscOptions& options) {
+    return huffmanCodeLengths(freqs, options.maxCodeLength, options.level > MAX_CLAMPED_LEVEL);
+}
+
+bool keepTable(
+        const std::vector<std::uint64_t>& freqs, const std::vector<std::uint8_t>& lengths,
+        const CscOptions& options) {
+    if (options.level > MAX_FAST_LEVEL || lengths.size() != freqs.size())
+        return false;
+    for (std::size_t sym = 0; sym < freqs.size(); sym++) {
+        if (freqs[sym] > 0 && lengths[sym] == 0)
+            return false;
+    }
+    return codedBits(freqs, lengths) <= entropyBits(freqs) * (1 + REUSE_TABLE_SLACK);
+}
@@ -0,0 +1,236 @@
+#include <lz.hpp>
+#include <algorithm>
+#include <cstring>
+
+constexpr unsigned LZ_HASH_BITS = 16;
+constexpr std::uint32_t LZ_NO_POSITION = UINT32_MAX;
+// a minimum-length match this far back costs about as much as its literals
+constexpr std::uint32_t LZ_TOO_FAR_FOR_MIN_MATCH = 1 << 14;
+
+// Search effort for each level
+struct LzLevel {
+    unsigned maxChain;   // candidates tried per position
+    unsigned niceLength; // stop searching once a match is this long
+    bool lazy;
+};
+
+constexpr LzLevel LZ_LEVELS[MAX_LZ_LEVEL + 1] = {
+    {0, 0, false},
+    {4, 16, false},
+    {8, 32, false},
+    {16, 32, false},
+    {16, 32, true},
+    {32, 64, true},
+    {64, 128, true},
+    {128, 128, true},
+    {256, 258, true},
+    {1024, 258, true},
+};
+
+static inline std::uint32_t hashAt(const std::byte* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, 4);
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// Length of the common prefix of a and b, up to limit bytes
+static inline std::uint32_t matchLength(
+        const std::byte* a, const std::byte* b, const std::uint32_t limit) {
+    std::uint32_t len = 0;
+    while (len + 8 <= limit) {
+        std::uint64_t x, y;
+        std::memcpy(&x, a + len, 8);
+        std::memcpy(&y, b + len, 8);
+        if (x != y)
+            break;
+        len += 8;
+    }
+    while (len < limit && a[len] == b[len])
+        len++;
+    return len;
+}
+
+// Hash chains over one block: head holds the latest position per hash, prev the one before
+class MatchFinder {
+    public:
+        MatchFinder(const std::byte* data, const std::size_t n, const LzLevel& level) :
+            data(data), n(n), level(level),
+            head((std::size_t) 1 << LZ_HASH_BITS, LZ_NO_POSITION), prev(n, LZ_NO_POSITION) {}
+
+        void insert(const std::size_t pos) {
+            if (pos + LZ_MIN_MATCH > n)
+                return;
+            std::uint32_t h = hashAt(data + pos);
+            prev[pos] = head[h];
+            head[h] = (std::uint32_t) pos;
+        }
+
+        // Longest match for pos among earlier inserted positions (length 0 if none)
+        LzToken find(const std::size_t pos) const {
+            LzToken best = {0, 0};
+            if (pos + LZ_MIN_MATCH > n)
+                return best;
+            const std::uint32_t limit = (std::uint32_t) std::min<std::size_t>(LZ_MAX_MATCH, n - pos);
+            std::uint32_t cand = head[hashAt(data + pos)];
+            for (unsigned chain = level.maxChain; cand != LZ_NO_POSITION && chain > 0; chain--) {
+                std::uint32_t dist = (std::uint32_t) (pos - cand);
+                if (dist > LZ_WINDOW_SIZE)
+                    break;
+                // a longer match has to agree at the current best length
+                if (best.length == 0 || data[cand + best.length] == data[pos + best.length]) {
+                    std::uint32_t len = matchLength(data + cand, data + pos, limit);
+                    if (len > best.length && (len > LZ_MIN_MATCH || dist <= LZ_TOO_FAR_FOR_MIN_MATCH)) {
+                        best = {len, dist};
+                        if (len >= level.niceLength || len == limit)
+                            break;
+                    }
+                }
+                cand = prev[cand];
+            }
+            if (best.length < LZ_MIN_MATCH)
+                best = {0, 0};
+            return best;
+        }
+
+    private:
+        const std::byte* data;
+        std::size_t n;
+        LzLevel level;
+        std::vector<std::uint32_t> head;
+        std::vector<std::uint32_t> prev;
+};
+
+std::vector<LzToken> lzParse(const std::byte* data, const std::size_t n, const unsigned level) {
+    const LzLevel& settings = LZ_LEVELS[std::min(std::max(level, MIN_LZ_LEVEL), MAX_LZ_LEVEL)];
+    MatchFinder finder(data, n, settings);
+    std::vector<LzToken> tokens = std::vector<LzToken>();
+    tokens.reserve(n / 4);
+    std::size_t pos = 0;
+    LzToken match = finder.find(pos);
+    while (pos < n) {
+        finder.insert(pos);
+        if (match.length == 0) {
+            tokens.push_back({(std::uint32_t) data[pos], 0});
+            pos++;
+            match = finder.find(pos);
+            continue;
+        }
+        if (settings.lazy && match.length < settings.niceLength) {
+            LzToken next = finder.find(pos + 1);
+            if (next.length > match.length + 1) {
+                tokens.push_back({(std::uint32_t) data[pos], 0});
+                pos++;
+                match = next;
+                continue;
+            }
+        }
+        tokens.push_back(match);
+        for (std::size_t end = pos + match.length; ++pos < end;)
+            finder.insert(pos);
+        match = finder.find(pos);
+    }
+    return tokens;
+}
+
+static inline unsigned floorLog2(std::uint32_t v) {
+    unsigned n = 0;
+    while (v >>= 1)
+        n++;
+    return n;
+}
+
+// The bucket code of v and its extra bits (see lz.hpp)
+static inline unsigned bucketOf(const std::uint32_t v, unsigned& extraBits, std::uint32_t& extra) {
+    if (v < 4) {
+        extraBits = 0;
+        extra = 0;
+        return v;
+    }
+    const unsigned n = floorLog2(v);
+    extraBits = n - 1;
+    extra = v & ((1U << extraBits) - 1);
+    return 2 * n + ((v >> extraBits) & 1);
+}
+
+static inline unsigned bucketExtraBits(const unsigned code) {
+    return code < 4 ? 0 : code / 2 - 1;
+}
+
+static inline std::uint32_t bucketBase(const unsigned code) {
+    return code < 4 ? code : (2U | (code & 1)) << (code / 2 - 1);
+}
+
+void countLzSymbols(
+        const std::vector<LzToken>& tokens,
+        std::vector<std::uint64_t>& litlenFreqs, std::vector<std::uint64_t>& distanceFreqs) {
+    unsigned extraBits;
+    std::uint32_t extra;
+    for (const LzToken& t : tokens) {
+        if (t.distance == 0) {
+            litlenFreqs[t.length]++;
+            continue;
+        }
+        litlenFreqs[256 + bucketOf(t.length - LZ_MIN_MATCH, extraBits, extra)]++;
+        distanceFreqs[bucketOf(t.distance - 1, extraBits, extra)]++;
+    }
+}
+
+void encodeLzTokens(
+        const std::vector<LzToken>& tokens, const EncodeTable& litlen,
+        const EncodeTable& distance, BitWriter& bw) {
+    unsigned extraBits;
+    std::uint32_t extra;
+    for (const LzToken& t : tokens) {
+        if (t.distance == 0) {
+            const HuffCode& c = litlen.codes[t.length];
+            bw.writeLong(c.bits, c.length);
+            continue;
+        }
+        const HuffCode& lc = litlen.codes[256 + bucketOf(t.length - LZ_MIN_MATCH, extraBits, extra)];
+        bw.writeLong(lc.bits, lc.length);
+        bw.writeLong(extra, extraBits);
+        const HuffCode& dc = distance.codes[bucketOf(t.distance - 1, extraBits, extra)];
+        bw.writeLong(dc.bits, dc.length);
+        bw.writeLong(extra, extraBits);
+    }
+}
+
+static inline std::uint32_t readExtra(BitReader& br, const unsigned n) {
+    if (n == 0)
+        return 0;
+    br.refill();
+    std::uint32_t v = (std::uint32_t) br.peek(n);
+    br.consume(n);
+    return v;
+}
+
+void decodeLzTokens(
+        const DecodeTable& litlen, const DecodeTable& distance,
+        BitReader& br, std::byte* out, const std::size_t n) {
+    std::size_t pos = 0;
+    while (pos < n) {
+        const unsigned sym = decodeSymbol(litlen, br);
+        if (sym < 256) {
+            out[pos++] = (std::byte) sym;
+            continue;
+        }
+        const unsigned lengthCode = sym - 256;
+        const std::uint32_t length =
+            LZ_MIN_MATCH + bucketBase(lengthCode) + readExtra(br, bucketExtraBits(lengthCode));
+        const unsigned distanceCode = decodeSymbol(distance, br);
+        const std::uint32_t dist =
+            1 + bucketBase(distanceCode) + readExtra(br, bucketExtraBits(distanceCode));
+        if (dist > pos || length > n - pos)
+            throw std::runtime_error("Invalid match in compressed data");
+        std::byte* dst = out + pos;
+        const std::byte* src = dst - dist;
+        if (dist >= length) {
+            std::memcpy(dst, src, length);
+        } else {
+            // overlapping copy repeats the last dist bytes
+            for (std::uint32_t i = 0; i < length; i++)
+                dst[i] = src[i];
+        }
+        pos += length;
+    }
+}
@@ -1,26 +1,77 @@
 #include <tests.hpp>
+#include <threadpool.hpp>
+#include <archive.hpp>
+#include <context.hpp>
+#include <lz.hpp>
+#include <stats.hpp>
+#include <dictionary.hpp>
+#include <ctime>
+#include <algorithm>
+#if defined(_WIN32)
+    #include <fcntl.h>
+    #include <io.h>
+#endif
 #include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
 
 void printHelp() {
     const std::string helpText = R"(
 Coalesce
 --------
 Syntax: 
-<csc|coalesce> <-c | -d | -h | -help> [-s] <FILES AND/OR DIRECTORIES> [--o <OUTPUT FILES AND/OR DIRECTORIES>]
+<csc|coalesce> <-c | -d | -t | -l | -train <DICTIONARY> | -h | -help> [-s] [-a] [-inc] [-1..-9] [-i] [-x <MEMBER>] [-maxbits <N>] [-ctx <N>] [-lz <LEVEL>] [-b <KiB>] [-j <N>] [-range <OFFSET> <LENGTH>] [-nocrc] [-tables <N>] [-D <DICTIONARY>] [-table <N>] [--stats <text|json>] <FILES AND/OR DIRECTORIES> [--o <OUTPUT FILES AND/OR DIRECTORIES>]
 ...Where [] == optional, <> == required (if no help flag set), and | == OR.
 
 Semantics: 
 -h | -help: help
 -c: compression mode 
 -d: decompression mode
+-t: test mode; decompress and verify checksums without writing anything
+-l: list the members of archives
+-train: build a dictionary of Huffman tables from sample files (and the files in directories) and save it as DICTIONARY
 -s: silent standard output
+-a: compress each directory, recursively, into a single archive (decompressing an archive extracts it)
+-inc: when compressing a directory, skip files unchanged since the last run (by size and mtime, then by contents) and delete outputs whose input is gone; a manifest of the inputs is kept in the output directory
+-1 .. -9: compression level (default 6); -1 to -3 estimate code tables from a sample of each block and reuse the previous block's table while it fits, -4 limits code lengths approximately, -5 and up cut data into more blocks where its byte distribution shifts, -7 to -9 also try the context model and (-8, -9) LZ on each block, keeping the smallest
+-i: code each block as 4 interleaved bitstreams, which decode faster (a file of any size becomes blocks)
+-x: only extract this archive member, or the members under this directory (can be repeated)
+-maxbits: longest Huffman code allowed when compressing, in bits (8-32, default 15)
+-ctx: code each byte with one of N tables chosen by the byte before it (2-16, e.g. 8), where that beats one table; better ratio for text and logs
+-lz: replace repeated strings with back-references at search LEVEL (1-9, 1 = fastest, e.g. 6), where that beats the other codings
+-b: block size in KiB; larger files are split into blocks coded in parallel (default 1024, at most 262144, 0 = never split)
+-j: number of worker threads shared by all files and blocks (default: one per hardware thread)
+-range: only decompress LENGTH bytes starting at byte OFFSET of the original file
+-nocrc: don't store checksums of the original data when compressing (saves 4 bytes per block)
+-tables: most tables for -train to build (1-64, default 8); more fit varied samples better
+-D: code small files with the best table of this dictionary where that beats storing their own, and decompress them (needs the same dictionary)
+-table: code every small file with this table of the -D dictionary, skipping the counting pass
+--stats: when done, print time spent per phase, bytes in and out and code table sizes over all inputs to standard error, as text or json
 --o: output list
+-: as an input or output, standard input or standard output (compressed in one pass, block by block)
 
     ++Basic Usage Example (compress and decompress the file testfile.txt):
 csc -c testfile.txt --o Newfolder/testfile
 csc -d new_folder/testfile --o Newfolder/original
 (Check out new_folder, it'll hold both the compressed and uncompressed file.)
 
+    ++Fastest and Smallest Compression Example:
+csc -c -1 big_log.txt --o fast/big_log
+csc -c -9 big_log.txt --o small/big_log
+
+    ++Archiving a Directory Tree and Extracting one Member Example:
+csc -c -a project --o project_archive
+csc -d -x src/main.cpp project_archive --o restored_project
+
+    ++Streaming Example (compress a tar stream, then unpack it again):
+tar cf - project | csc -c - > project.tar.csc
+csc -d - --o - < project.tar.csc | tar xf -
+
+    ++Many Small Files with a Shared Dictionary Example:
+csc -train configs.csd sample_configs
+csc -c -D configs.csd configs --o compressed_configs
+csc -d -D configs.csd compressed_configs --o restored_configs
+
     ++Compressing and Decompressing the whole Current Working Directory Example:
 csc -c . --o compression_folder
 csc -d compression_folder --o decompression_folder
@@ -54,9 +105,16 @@ int main(int argc, char* argv[]) {
     bool verbose = true;
     bool decode = false;
     bool isDir = false;
+    bool archive = false;
+    bool list = false;
     std::vector<std::string> outputs;
     std::vector<std::string> targets;
     std::vector<bool> dirTracker;
+    CscOptions options;
+    std::string statsFormat;
+    std::string trainPath;
+    unsigned numTables = DEFAULT_DICTIONARY_TABLES;
+    CscDictionary dictionary;
     if (argc == 2 && (strcmp(argv[1], "-h") || strcmp(argv[1], "-help") )) {
         printHelp();
         return 0;
@@ -68,10 +126,128 @@ int main(int argc, char* argv[]) {
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "-d") == 0) {
             decode = true;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            decode = true;
+            options.testOnly = true;
         } else if (strcmp(argv[i], "-c") == 0) {
             decode = false;
         } else if (strcmp(argv[i], "-s") == 0) {
             verbose = false;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            archive = true;
+        } else if (strcmp(argv[i], "-inc") == 0) {
+            options.incremental = true;
+        } else if (argv[i][0] == '-' && argv[i][1] >= '0' + (int) MIN_LEVEL
+                   && argv[i][1] <= '0' + (int) MAX_LEVEL && argv[i][2] == '\0') {
+            options.level = (unsigned) (argv[i][1] - '0');
+        } else if (strcmp(argv[i], "-i") == 0) {
+            options.interleave = true;
+        } else if (strcmp(argv[i], "-train") == 0) {
+            i++;
+            if (i >= argc) {
+                std::cerr << "Error: -train option requires a dictionary filename" << std::endl;
+                return 1;
+            }
+            trainPath = argv[i];
+            decode = false;
+        } else if (strcmp(argv[i], "-tables") == 0) {
+            i++;
+            numTables = (i < argc) ? (unsigned) atoi(argv[i]) : 0;
+            if (numTables < MIN_DICTIONARY_TABLES || numTables > MAX_DICTIONARY_TABLES) {
+                std::cerr << "Error: -tables option requires a number from "
+                          << MIN_DICTIONARY_TABLES << " to " << MAX_DICTIONARY_TABLES << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-D") == 0) {
+            i++;
+            if (i >= argc) {
+                std::cerr << "Error: -D option requires a dictionary filename" << std::endl;
+                return 1;
+            }
+            try {
+                dictionary = readDictionary(argv[i]);
+            } catch (const std::exception& e) {
+                std::cerr << "Error reading dictionary " << argv[i] << ": " << e.what() << std::endl;
+                return 1;
+            }
+            options.dictionary = &dictionary;
+        } else if (strcmp(argv[i], "-table") == 0) {
+            i++;
+            if (i >= argc || !isdigit((unsigned char) argv[i][0])) {
+                std::cerr << "Error: -table option requires a table number" << std::endl;
+                return 1;
+            }
+            options.dictionaryTable = (unsigned) atoi(argv[i]);
+        } else if (strcmp(argv[i], "-nocrc") == 0) {
+            options.checksums = false;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            list = true;
+            decode = true;
+        } else if (strcmp(argv[i], "-x") == 0) {
+            i++;
+            if (i >= argc) {
+                std::cerr << "Error: -x option requires an archive member path" << std::endl;
+                return 1;
+            }
+            options.members.push_back(argv[i]);
+        } else if (strcmp(argv[i], "-maxbits") == 0) {
+            i++;
+            unsigned maxBits = (i < argc) ? (unsigned) atoi(argv[i]) : 0;
+            if (maxBits < MIN_MAX_CODE_LENGTH || maxBits > MAX_MAX_CODE_LENGTH) {
+                std::cerr << "Error: -maxbits option requires a number from "
+                          << MIN_MAX_CODE_LENGTH << " to " << MAX_MAX_CODE_LENGTH << std::endl;
+                return 1;
+            }
+            options.maxCodeLength = maxBits;
+        } else if (strcmp(argv[i], "-ctx") == 0) {
+            i++;
+            unsigned clusters = (i < argc) ? (unsigned) atoi(argv[i]) : 0;
+            if (clusters < MIN_CONTEXT_CLUSTERS || clusters > MAX_CONTEXT_CLUSTERS) {
+                std::cerr << "Error: -ctx option requires a number from "
+                          << MIN_CONTEXT_CLUSTERS << " to " << MAX_CONTEXT_CLUSTERS << std::endl;
+                return 1;
+            }
+            options.contextClusters = clusters;
+        } else if (strcmp(argv[i], "-lz") == 0) {
+            i++;
+            unsigned level = (i < argc) ? (unsigned) atoi(argv[i]) : 0;
+            if (level < MIN_LZ_LEVEL || level > MAX_LZ_LEVEL) {
+                std::cerr << "Error: -lz option requires a level from "
+                          << MIN_LZ_LEVEL << " to " << MAX_LZ_LEVEL << std::endl;
+                return 1;
+            }
+            options.lzLevel = level;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            i++;
+            if (i >= argc || !isdigit((unsigned char) argv[i][0])
+                    || strtoull(argv[i], nullptr, 10) > MAX_BLOCK_SIZE / 1024) {
+                std::cerr << "Error: -b option requires a block size in KiB of at most "
+                          << MAX_BLOCK_SIZE / 1024 << std::endl;
+                return 1;
+            }
+            options.blockSize = (std::size_t) strtoull(argv[i], nullptr, 10) * 1024;
+        } else if (strcmp(argv[i], "-j") == 0) {
+            i++;
+            if (i >= argc || atoi(argv[i]) < 1) {
+                std::cerr << "Error: -j option requires a thread count of at least 1" << std::endl;
+                return 1;
+            }
+            options.threads = (std::size_t) atoi(argv[i]);
+        } else if (strcmp(argv[i], "-range") == 0) {
+            if (i + 2 >= argc || !isdigit((unsigned char) argv[i + 1][0])
+                    || !isdigit((unsigned char) argv[i + 2][0])) {
+                std::cerr << "Error: -range option requires an offset and a length in bytes" << std::endl;
+                return 1;
+            }
+            options.rangeStart = strtoull(argv[++i], nullptr, 10);
+            options.rangeLength = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            i++;
+            if (i >= argc || (strcmp(argv[i], "text") != 0 && strcmp(argv[i], "json") != 0)) {
+                std::cerr << "Error: --stats option requires text or json" << std::endl;
+                return 1;
+            }
+            statsFormat = argv[i];
         } else if (strcmp(argv[i], "--o") == 0) {
             i++;
             if (i >= argc) {
@@ -80,12 +256,15 @@ int main(int argc, char* argv[]) {
             }
             for (; i < argc; i++) {
                 std::filesystem::path p(argv[i]);
-                if (decode) {
+                if (decode && argv[i] != STDIO_PATH) {
                     auto pNoExt = std::filesystem::path(p.string()).replace_extension("");
                     p = std::filesystem::exists(pNoExt) ? p : pNoExt;
                 }                      
                 outputs.push_back(p.string());
             }
+        } else if (argv[i] == STDIO_PATH) {
+            dirTracker.push_back(false);
+            targets.push_back(STDIO_PATH);
         } else {
             std::filesystem::path p(argv[i]);
             if (decode && (tryFindCompressed(p) == 1)) {
@@ -99,14 +278,63 @@ int main(int argc, char* argv[]) {
         std::cerr << "Error: No files or directories passed" << std::endl;
         return 1;          
     }
-    else if (outputs.size() > targets.size()) {
+    if (!trainPath.empty()) {
+        try {
+            CscDictionary trained = trainDictionary(targets, numTables, options.maxCodeLength);
+            writeDictionary(trained, trainPath);
+            if (verbose)
+                std::cout << "Trained " << trained.lengths.size() << " table(s) into "
+                          << trainPath << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Error training " << trainPath << ": " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (options.dictionaryTable != BEST_DICTIONARY_TABLE
+            && (options.dictionary == nullptr || options.dictionaryTable >= dictionary.lengths.size())) {
+        std::cerr << "Error: -table option requires a table of the -D dictionary" << std::endl;
+        return 1;
+    }
+    if (list) {
+        int ret = 0;
+        for (const std::string& target : targets) {
+            std::vector<ArchiveMember> members;
+            try {
+                members = listArchive(target);
+            } catch (const std::exception& e) {
+                std::cerr << "Error listing " << target << ": " << e.what() << std::endl;
+                ret = 1;
+                continue;
+            }
+            std::cout << target << ":\n";
+            for (const ArchiveMember& m : members) {
+                char mtime[32] = "";
+                std::time_t t = (std::time_t) m.mtime;
+                std::tm* tm = std::localtime(&t);
+                if (tm != nullptr)
+                    std::strftime(mtime, sizeof(mtime), "%Y-%m-%d %H:%M:%S", tm);
+                std::cout << m.size << "\t" << m.offset << "\t" << mtime << "\t" << m.path << "\n";
+            }
+        }
+        return ret;
+    }
+    if (outputs.size() > targets.size()) {
         (std::cerr << "Error: more outputs (" 
                    << outputs.size() << ") than targets "
                    << "(" << targets.size() << ")" << std::endl);
         return 1; 
     } else {
         for (int r = outputs.size(); r < targets.size(); r++) {
-            if (dirTracker[r]) {
+            if (targets[r] == STDIO_PATH) {
+                outputs.push_back(STDIO_PATH);
+            } else if (dirTracker[r] && archive && !decode) {
+                // name the archive after the directory, in the current folder
+                auto dir = std::filesystem::absolute(targets[r]).lexically_normal();
+                if (!dir.has_filename())
+                    dir = dir.parent_path();
+                outputs.push_back(dir.filename().string());
+            } else if (dirTracker[r]) {
                 outputs.push_back(std::filesystem::current_path().string());
             } else {
                 std::string replExt = decode ? "" : COMPRESSION_EXT;
@@ -117,15 +345,59 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    // Process each target (file or directory)
+    if (std::find(outputs.begin(), outputs.end(), STDIO_PATH) != outputs.end()) {
+        // keep messages out of the data on standard output
+        verbose = false;
+    }
+#if defined(_WIN32)
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    // Process each target (file or directory) concurrently on one pool
+    ThreadPool pool(options.threads);
+    options.pool = &pool;
+    CscStats stats;
+    if (!statsFormat.empty())
+        options.stats = &stats;
+    std::vector<std::future<std::size_t>> failures = std::vector<std::future<std::size_t>>();
     for (int i = 0; i < targets.size(); i++) {
         std::string output = outputs[i];
         std::string target = targets[i];
-        if (dirTracker[i]) {
-            processDirectory(target, output, decode, verbose);
-        } else {
-            processFile(target, output, decode, verbose);
-        }
+        bool isDir = dirTracker[i];
+        failures.push_back(pool.submit([=]() -> std::size_t {
+            bool streaming = (target == STDIO_PATH || output == STDIO_PATH);
+            if (!isDir && !streaming)
+                return tryProcessFile(target, output, decode, verbose, options) ? 0 : 1;
+            try {
+                if (streaming) {
+                    processStream(target, output, decode, options);
+                    return 0;
+                }
+                if (archive && !decode) {
+                    std::string archiveFile = std::filesystem::path(output).replace_extension(
+                        COMPRESSION_EXT).string();
+                    createDirsIfNeeded(archiveFile, verbose);
+                    writeArchive(target, archiveFile, verbose, options);
+                    return 0;
+                }
+                return processDirectory(target, output, decode, verbose, options);
+            } catch (const std::exception& e) {
+                printMessage(std::cerr, "Error processing " + target + ": " + e.what() + "\n");
+                return 1;
+            }
+        }));
+    }
+    std::size_t numFailed = 0;
+    for (std::future<std::size_t>& f : failures)
+        numFailed += f.get();
+    if (statsFormat == "json")
+        std::cerr << statsJson(stats) << std::endl;
+    else if (!statsFormat.empty())
+        std::cerr << statsText(stats);
+    if (numFailed > 0) {
+        printMessage(std::cerr, std::to_string(numFailed) + " file(s) failed\n");
+        return 1;
     }
     if (verbose)
         std::cout << "All done!" << std::endl;
@@ -0,0 +1,113 @@
+#include <pipeline.hpp>
+#include <stats.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+AsyncReader::AsyncReader(
+        std::istream& rf, const std::size_t chunkSize, const std::uint64_t limit, CscStats* stats,
+        const bool threaded) :
+    rf(rf), chunkSize(chunkSize), limit(limit), chunks(PIPELINE_DEPTH), stats(stats) {
+    if (threaded)
+        thread = std::thread([this]() { run(); });
+}
+
+AsyncReader::~AsyncReader() {
+    chunks.close();
+    if (thread.joinable())
+        thread.join();
+}
+
+bool AsyncReader::read(std::vector<std::byte>& chunk) {
+    if (ended || limit == 0)
+        return false;
+    chunk.resize((std::size_t) std::min<std::uint64_t>(chunkSize, limit));
+    timePhase(stats, Phase::io, [&]() {
+        rf.read(reinterpret_cast<char*>(chunk.data()), chunk.size());
+    });
+    if (rf.bad())
+        throw std::runtime_error("Can't read the input");
+    const std::size_t got = (std::size_t) rf.gcount();
+    ended = got < chunk.size();
+    chunk.resize(got);
+    limit -= got;
+    return got > 0;
+}
+
+void AsyncReader::run() {
+    try {
+        for (std::vector<std::byte> chunk; read(chunk);) {
+            if (!chunks.push(std::move(chunk)))
+                break;
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    chunks.close();
+}
+
+bool AsyncReader::next(std::vector<std::byte>& chunk) {
+    if (!thread.joinable())
+        return read(chunk);
+    if (chunks.pop(chunk))
+        return true;
+    if (error)
+        std::rethrow_exception(error);
+    return false;
+}
+
+AsyncWriter::AsyncWriter(std::ostream& wf, CscStats* stats, const bool threaded) :
+    wf(wf), chunks(PIPELINE_DEPTH), stats(stats) {
+    if (threaded)
+        thread = std::thread([this]() { run(); });
+}
+
+AsyncWriter::~AsyncWriter() {
+    chunks.close();
+    if (thread.joinable())
+        thread.join();
+}
+
+void AsyncWriter::writeChunk(const std::vector<std::byte>& chunk) {
+    PhaseTimer timer(stats, Phase::io);
+    wf.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    wf.flush();
+    if (!wf)
+        throw std::runtime_error("Can't write the output");
+}
+
+void AsyncWriter::run() {
+    std::vector<std::byte> chunk;
+    while (chunks.pop(chunk)) {
+        {
+            std::lock_guard<std::mutex> guard(errorLock);
+            // keep taking chunks after an error, so write never waits forever
+            if (error)
+                continue;
+        }
+        try {
+            writeChunk(chunk);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(errorLock);
+            error = std::current_exception();
+        }
+    }
+}
+
+void AsyncWriter::write(std::vector<std::byte> chunk) {
+    if (!thread.joinable())
+        return writeChunk(chunk);
+    {
+        std::lock_guard<std::mutex> guard(errorLock);
+        if (error)
+            std::rethrow_exception(error);
+    }
+    chunks.push(std::move(chunk));
+}
+
+void AsyncWriter::finish() {
+    chunks.close();
+    if (thread.joinable())
+        thread.join();
+    if (error)
+        std::rethrow_exception(error);
+}
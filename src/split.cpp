@@ -0,0 +1,85 @@
+#include <split.hpp>
+#include <histogram.hpp>
+#include <stats.hpp>
+#include <algorithm>
+
+double estimatedBlockBytes(const std::vector<std::uint64_t>& freqs, const std::uint64_t n) {
+    const std::size_t used = (std::size_t) std::count_if(
+        freqs.begin(), freqs.end(), [](std::uint64_t f) { return f > 0; });
+    return SPLIT_FRAME_COST + std::min<double>((double) n, entropyBits(freqs) / 8 + used);
+}
+
+static void addCounts(std::vector<std::uint64_t>& to, const std::vector<std::uint64_t>& from) {
+    for (std::size_t sym = 0; sym < 256; sym++)
+        to[sym] += from[sym];
+}
+
+static void subtractCounts(std::vector<std::uint64_t>& from, const std::vector<std::uint64_t>& counts) {
+    for (std::size_t sym = 0; sym < 256; sym++)
+        from[sym] -= counts[sym];
+}
+
+std::vector<SplitPart> findSplits(const std::byte* data, const std::size_t n, CscStats* stats) {
+    const std::size_t numWindows = (n + SPLIT_WINDOW_SIZE - 1) / SPLIT_WINDOW_SIZE;
+    if (numWindows < 2)
+        return {{n, timePhase(stats, Phase::histogram, [&]() { return byteHistogram(data, n); })}};
+    auto windowSize = [&](std::size_t w) {
+        return std::min(SPLIT_WINDOW_SIZE, n - w * SPLIT_WINDOW_SIZE);
+    };
+    std::vector<std::vector<std::uint64_t>> windows = timePhase(stats, Phase::histogram, [&]() {
+        std::vector<std::vector<std::uint64_t>> counts = std::vector<std::vector<std::uint64_t>>();
+        for (std::size_t w = 0; w < numWindows; w++)
+            counts.push_back(byteHistogram(data + w * SPLIT_WINDOW_SIZE, windowSize(w)));
+        return counts;
+    });
+    PhaseTimer timer(stats, Phase::model);
+    std::vector<SplitPart> parts = std::vector<SplitPart>();
+    // the part so far, the windows before w
+    std::vector<std::uint64_t> part = windows[0];
+    std::size_t partBytes = windowSize(0);
+    // windows [w, lookEnd)
+    std::vector<std::uint64_t> lookahead(256, 0);
+    std::size_t lookEnd = 1;
+    std::size_t lookBytes = 0;
+    // the estimated bytes saved by coding before and after as two blocks instead of one
+    auto splitSaving = [](const std::vector<std::uint64_t>& before, const std::size_t beforeBytes,
+                          const std::vector<std::uint64_t>& after, const std::size_t afterBytes) {
+        std::vector<std::uint64_t> merged = before;
+        addCounts(merged, after);
+        return estimatedBlockBytes(merged, beforeBytes + afterBytes)
+            - estimatedBlockBytes(before, beforeBytes) - estimatedBlockBytes(after, afterBytes);
+    };
+    for (std::size_t w = 1; w < numWindows; w++) {
+        for (; lookEnd < std::min(numWindows, w + SPLIT_LOOKAHEAD_WINDOWS); lookEnd++) {
+            addCounts(lookahead, windows[lookEnd]);
+            lookBytes += windowSize(lookEnd);
+        }
+        const double saving = splitSaving(part, partBytes, lookahead, lookBytes);
+        bool split = saving > lookBytes * MIN_SPLIT_GAIN;
+        if (split) {
+            // a shift further into the lookahead is split at when the window gets there
+            std::vector<std::uint64_t> before = part;
+            std::vector<std::uint64_t> after = lookahead;
+            std::size_t beforeBytes = partBytes;
+            std::size_t afterBytes = lookBytes;
+            for (std::size_t b = w + 1; split && b < lookEnd; b++) {
+                addCounts(before, windows[b - 1]);
+                subtractCounts(after, windows[b - 1]);
+                beforeBytes += windowSize(b - 1);
+                afterBytes -= windowSize(b - 1);
+                split = splitSaving(before, beforeBytes, after, afterBytes) <= saving;
+            }
+        }
+        if (split) {
+            parts.push_back({partBytes, std::move(part)});
+            part.assign(256, 0);
+            partBytes = 0;
+        }
+        addCounts(part, windows[w]);
+        partBytes += windowSize(w);
+        subtractCounts(lookahead, windows[w]);
+        lookBytes -= windowSize(w);
+    }
+    parts.push_back({partBytes, std::move(part)});
+    return parts;
+}
@@ -0,0 +1,84 @@
+#include <stats.hpp>
+#include <algorithm>
+#include <cstdio>
+
+const char* phaseName(const Phase phase) {
+    switch (phase) {
+        case Phase::histogram:   return "histogram";
+        case Phase::model:       return "model";
+        case Phase::codeLengths: return "code_lengths";
+        case Phase::header:      return "header";
+        case Phase::encode:      return "encode";
+        case Phase::decode:      return "decode";
+        case Phase::checksum:    return "checksum";
+        case Phase::io:          return "io";
+        default:                 return "unknown";
+    }
+}
+
+static double secondsOf(const std::uint64_t nanos) {
+    return nanos / 1e9;
+}
+
+static double wallSeconds(const CscStats& stats) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - stats.start).count();
+}
+
+// bytes out over bytes in, or a negative number when bytes in aren't known
+static double ratioOf(const CscStats& stats) {
+    const std::uint64_t in = stats.bytesIn.load();
+    return in == 0 ? -1 : (double) stats.bytesOut.load() / in;
+}
+
+static std::string format(const char* fmt, const double value) {
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), fmt, value);
+    return buffer;
+}
+
+std::string statsText(const CscStats& stats) {
+    const double wall = wallSeconds(stats);
+    std::string text = "Stats:\n";
+    text += "  files            " + std::to_string(stats.files.load()) + "\n";
+    text += "  blocks           " + std::to_string(stats.blocks.load()) + "\n";
+    text += "  bytes in         " + std::to_string(stats.bytesIn.load()) + "\n";
+    text += "  bytes out        " + std::to_string(stats.bytesOut.load()) + "\n";
+    const double ratio = ratioOf(stats);
+    text += "  out/in ratio     " + (ratio < 0 ? std::string("-") : format("%.4f", ratio)) + "\n";
+    text += "  code tables      " + std::to_string(stats.codeTables.load()) + "\n";
+    text += "  max symbols      " + std::to_string(stats.maxSymbols.load()) + "\n";
+    text += "  max code length  " + std::to_string(stats.maxCodeLength.load()) + "\n";
+    text += "  wall time        " + format("%.3f s", wall) + "\n";
+    text += "  MB/s             "
+        + format("%.1f", wall > 0 ? std::max(stats.bytesIn.load(), stats.bytesOut.load()) / 1e6 / wall : 0)
+        + "\n";
+    text += "  phase times, summed over threads:\n";
+    for (std::size_t p = 0; p < (std::size_t) Phase::count; p++) {
+        std::string name = phaseName((Phase) p);
+        text += "    " + name + std::string(14 - name.size(), ' ')
+            + format("%.3f s", secondsOf(stats.phaseNanos[p].load())) + "\n";
+    }
+    return text;
+}
+
+std::string statsJson(const CscStats& stats) {
+    const double wall = wallSeconds(stats);
+    std::string json = "{";
+    json += "\"files\":" + std::to_string(stats.files.load());
+    json += ",\"blocks\":" + std::to_string(stats.blocks.load());
+    json += ",\"bytes_in\":" + std::to_string(stats.bytesIn.load());
+    json += ",\"bytes_out\":" + std::to_string(stats.bytesOut.load());
+    const double ratio = ratioOf(stats);
+    json += ",\"ratio\":" + (ratio < 0 ? std::string("null") : format("%.6f", ratio));
+    json += ",\"code_tables\":" + std::to_string(stats.codeTables.load());
+    json += ",\"max_symbols\":" + std::to_string(stats.maxSymbols.load());
+    json += ",\"max_code_length\":" + std::to_string(stats.maxCodeLength.load());
+    json += ",\"wall_seconds\":" + format("%.6f", wall);
+    json += ",\"phase_seconds\":{";
+    for (std::size_t p = 0; p < (std::size_t) Phase::count; p++) {
+        json += (p > 0 ? ",\"" : "\"") + std::string(phaseName((Phase) p)) + "\":"
+            + format("%.6f", secondsOf(stats.phaseNanos[p].load()));
+    }
+    json += "}}";
+    return json;
+}
@@ -0,0 +1,95 @@
+#include <threadpool.hpp>
+
+thread_local ThreadPool* ThreadPool::currentPool = nullptr;
+thread_local std::size_t ThreadPool::currentId = 0;
+
+std::size_t resolveThreadCount(const std::size_t requested) {
+    if (requested > 0)
+        return requested;
+    std::size_t hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+ThreadPool::ThreadPool(const std::size_t numThreads) {
+    std::size_t n = resolveThreadCount(numThreads);
+    for (std::size_t i = 0; i < n; i++)
+        queues.push_back(std::make_unique<WorkQueue>());
+    for (std::size_t i = 0; i < n; i++)
+        workers.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+std::size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+void ThreadPool::push(std::function<void()> task) {
+    WorkQueue& queue = (currentPool == this) ? *queues[currentId] : shared;
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+    queued++;
+    // taking sleepLock orders this with a worker checking queued before sleeping
+    std::lock_guard<std::mutex> guard(sleepLock);
+    wake.notify_one();
+    if (waiting > 0)
+        progress.notify_all();
+}
+
+bool ThreadPool::tryTake(std::function<void()>& task) {
+    auto takeFrom = [&](WorkQueue& queue) {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty())
+            return false;
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        queued--;
+        return true;
+    };
+    const bool isWorker = (currentPool == this);
+    if (isWorker && takeFrom(*queues[currentId]))
+        return true;
+    if (takeFrom(shared))
+        return true;
+    for (std::size_t i = 1; i <= queues.size(); i++) {
+        std::size_t victim = ((isWorker ? currentId : 0) + i) % queues.size();
+        if (takeFrom(*queues[victim]))
+            return true;
+    }
+    return false;
+}
+
+bool ThreadPool::runPending() {
+    std::function<void()> task;
+    if (!tryTake(task))
+        return false;
+    task();
+    // the task may have been the one a waiting worker needs
+    std::lock_guard<std::mutex> guard(sleepLock);
+    if (waiting > 0)
+        progress.notify_all();
+    return true;
+}
+
+void ThreadPool::work(const std::size_t id) {
+    currentPool = this;
+    currentId = id;
+    while (true) {
+        if (runPending())
+            continue;
+        std::unique_lock<std::mutex> guard(sleepLock);
+        wake.wait(guard, [this]() { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
@@ -23,9 +23,630 @@ bool _AllWriteTest() {
     return _printPassAndReturn("AllWriteTest", success);
 }
 
+bool _sameContents(const std::string file1, const std::string file2) {
+    std::ifstream rf1(file1, std::ios::binary | std::ios::in);
+    std::ifstream rf2(file2, std::ios::binary | std::ios::in);
+    char b1, b2;
+    bool success = rf1 && rf2;
+    while (success && rf1.get(b1)) {
+        if (!rf2.get(b2) || b1 != b2) {
+            success = false;
+        }
+    }
+    return success && !rf2.get(b2);
+}
+
+std::string _referenceImage() {
+    std::ifstream rf("reference.jpg", std::ios::binary | std::ios::in);
+    std::stringstream contents;
+    contents << rf.rdbuf();
+    return contents.str();
+}
+
+bool _V1DecodeTest() {
+    std::string stem = "y_v1";
+    std::filesystem::remove(stem + ".jpg");
+    writeDecompFile("y.csc", stem, false);
+    bool success = _sameContents("reference.jpg", stem + ".jpg");
+    std::filesystem::remove(stem + ".jpg");
+    return _printPassAndReturn("V1DecodeTest", success);
+}
+
+bool _BlockRoundTripTest() {
+    std::string stem = "y_blocks";
+    CscOptions options;
+    options.blockSize = 4096;
+    options.threads = 3;
+    std::filesystem::remove(stem + ".csc");
+    std::filesystem::remove(stem + ".jpg");
+    writeCompFile("reference.jpg", stem + ".csc", false, true, options);
+    writeDecompFile(stem + ".csc", stem, false);
+    bool success = _sameContents("reference.jpg", stem + ".jpg");
+    std::filesystem::remove(stem + ".csc");
+    std::filesystem::remove(stem + ".jpg");
+    return _printPassAndReturn("BlockRoundTripTest", success);
+}
+
+bool _RangeDecodeTest() {
+    std::string text;
+    for (unsigned i = 0; text.size() < 10 * 4096; i++)
+        text += "record " + std::to_string(i * 7919 % 10007) + " in the range\n";
+    std::ofstream("range.txt", std::ios::binary) << text;
+    CscOptions options;
+    options.blockSize = 4096;
+    options.threads = 3;
+    writeCompFile("range.txt", "range.csc", false, false, options);
+    bool success = true;
+    // within one block, across several, and running past the end
+    const std::pair<std::uint64_t, std::uint64_t> ranges[] = {
+        {100, 50}, {2 * 4096 - 100, 3 * 4096 + 7}, {text.size() - 5000, 9000}};
+    for (const auto& [start, length] : ranges) {
+        std::filesystem::remove("range_part.txt");
+        options.rangeStart = start;
+        options.rangeLength = length;
+        writeDecompFile("range.csc", "range_part.txt", false, false, options);
+        std::ifstream rf("range_part.txt", std::ios::binary | std::ios::in);
+        std::stringstream part;
+        part << rf.rdbuf();
+        success = success && part.str() == text.substr(start, length);
+    }
+    for (const char* f : {"range.txt", "range.csc", "range_part.txt"})
+        std::filesystem::remove(f);
+    return _printPassAndReturn("RangeDecodeTest", success);
+}
+
+bool _ArchiveRoundTripTest() {
+    std::string src = "archive_src";
+    std::string stem = "archive_test";
+    std::filesystem::remove_all(src);
+    std::filesystem::remove_all(stem);
+    std::filesystem::remove(stem + ".csc");
+    std::filesystem::create_directories(src + "/sub/deeper");
+    std::filesystem::copy_file("reference.jpg", src + "/sub/reference.jpg");
+    std::filesystem::copy_file("y.txt", src + "/sub/deeper/y.txt");
+    std::ofstream(src + "/empty.txt").close();
+    CscOptions options;
+    options.blockSize = 4096;
+    options.threads = 3;
+    writeArchive(src, stem + ".csc", false, options);
+    bool success = listArchive(stem + ".csc").size() == 3;
+    // each block is decoded once, even those shared by a member spanning blocks and another
+    CscStats tested;
+    CscStats extracted;
+    options.stats = &tested;
+    testArchive(stem + ".csc", options);
+    options.stats = &extracted;
+    extractArchive(stem + ".csc", stem, false, options);
+    options.stats = nullptr;
+    success = success && extracted.blocks == tested.blocks
+        && _sameContents(src + "/sub/reference.jpg", stem + "/sub/reference.jpg")
+        && _sameContents(src + "/sub/deeper/y.txt", stem + "/sub/deeper/y.txt")
+        && _sameContents(src + "/empty.txt", stem + "/empty.txt");
+    // a single member only
+    std::filesystem::remove_all(stem);
+    options.members = {"sub/deeper"};
+    extractArchive(stem + ".csc", stem, false, options);
+    success = success && _sameContents(src + "/sub/deeper/y.txt", stem + "/sub/deeper/y.txt")
+        && !std::filesystem::exists(stem + "/sub/reference.jpg");
+    std::filesystem::remove_all(src);
+    std::filesystem::remove_all(stem);
+    std::filesystem::remove(stem + ".csc");
+    return _printPassAndReturn("ArchiveRoundTripTest", success);
+}
+
+bool _PipelineTest() {
+    std::string text;
+    for (unsigned i = 0; i < 1000; i++)
+        text += std::to_string(i) + ",";
+    // read ahead in chunks, stopping at the limit, and written back in order
+    bool success = true;
+    for (bool threaded : {true, false}) {
+        std::istringstream in(text);
+        std::ostringstream out;
+        std::size_t chunks = 0;
+        {
+            AsyncReader reader(in, 100, 1234, nullptr, threaded);
+            AsyncWriter writer(out, nullptr, threaded);
+            for (std::vector<std::byte> chunk; reader.next(chunk); chunks++)
+                writer.write(std::move(chunk));
+            writer.finish();
+        }
+        success = success && chunks == 13 && out.str() == text.substr(0, 1234)
+            && in.tellg() == (std::streampos) 1234;
+    }
+    // a reader dropped early stops without reading everything
+    std::istringstream again(text);
+    {
+        AsyncReader reader(again, 10, UINT64_MAX, nullptr);
+        std::vector<std::byte> chunk;
+        success = success && reader.next(chunk) && chunk.size() == 10;
+    }
+    return _printPassAndReturn("PipelineTest", success);
+}
+
+bool _IncrementalTest() {
+    std::string src = "incremental_src";
+    std::string out = "incremental_out";
+    std::filesystem::remove_all(src);
+    std::filesystem::remove_all(out);
+    std::filesystem::create_directories(src);
+    std::filesystem::copy_file("y.txt", src + "/a.txt");
+    std::filesystem::copy_file("reference.jpg", src + "/b.jpg");
+    // the same stem as a.txt, which mustn't share its output
+    std::filesystem::copy_file("reference.jpg", src + "/a.jpg");
+    CscOptions options;
+    options.incremental = true;
+    bool success = processDirectory(src, out, false, false, options) == 0
+        && std::filesystem::exists(out + "/a.txt.csc") && std::filesystem::exists(out + "/b.jpg.csc")
+        && std::filesystem::exists(out + "/a.jpg.csc");
+    // an unchanged input isn't recompressed, even with a new mtime
+    const auto marked = std::filesystem::last_write_time(out + "/a.txt.csc") - std::chrono::hours(1);
+    std::filesystem::last_write_time(out + "/a.txt.csc", marked);
+    std::filesystem::last_write_time(src + "/a.txt", std::filesystem::file_time_type::clock::now());
+    success = success && processDirectory(src, out, false, false, options) == 0
+        && std::filesystem::last_write_time(out + "/a.txt.csc") == marked;
+    // a changed input is, and a removed one loses its output
+    std::ofstream(src + "/a.txt", std::ios::app) << "one more line\n";
+    std::filesystem::remove(src + "/b.jpg");
+    success = success && processDirectory(src, out, false, false, options) == 0
+        && std::filesystem::last_write_time(out + "/a.txt.csc") != marked
+        && !std::filesystem::exists(out + "/b.jpg.csc");
+    writeDecompFile(out + "/a.txt.csc", out + "/a_restored.txt", false);
+    writeDecompFile(out + "/a.jpg.csc", out + "/a_restored.jpg", false);
+    success = success && _sameContents(src + "/a.txt", out + "/a_restored.txt")
+        && _sameContents(src + "/a.jpg", out + "/a_restored.jpg");
+    std::filesystem::remove_all(src);
+    std::filesystem::remove_all(out);
+    return _printPassAndReturn("IncrementalTest", success);
+}
+
+bool _StreamRoundTripTest() {
+    const std::string original = _referenceImage();
+    CscOptions options;
+    options.blockSize = 4096;
+    options.threads = 3;
+    std::istringstream in(original);
+    std::stringstream compressed;
+    compressStream(in, compressed, ".jpg", options);
+    std::stringstream decompressed;
+    decompressStream(compressed, decompressed, options);
+    bool success = decompressed.str() == original;
+    return _printPassAndReturn("StreamRoundTripTest", success);
+}
+
+bool _LevelsTest() {
+    // Fibonacci counts make the deepest tree, which the clamp has to cut to 8 bits
+    std::vector<std::uint64_t> freqs(40);
+    freqs[0] = freqs[1] = 1;
+    for (std::size_t i = 2; i < freqs.size(); i++)
+        freqs[i] = freqs[i - 1] + freqs[i - 2];
+    std::vector<std::uint8_t> clamped = huffmanCodeLengths(freqs, 8, false);
+    std::vector<std::uint8_t> optimal = huffmanCodeLengths(freqs, 8);
+    std::uint64_t kraft = 0;
+    for (std::uint8_t len : clamped)
+        kraft += len > 0 ? (std::uint64_t) 1 << (8 - len) : 0;
+    bool success = *std::max_element(clamped.begin(), clamped.end()) == 8 && kraft <= 256
+        && std::count(clamped.begin(), clamped.end(), 0) == 0
+        && codedBits(freqs, clamped) < codedBits(freqs, optimal) * 1.05;
+    // text then a JPEG in one block: only splitting levels give each its own table
+    const std::string image = _referenceImage();
+    std::string mixed;
+    for (unsigned i = 0; mixed.size() < image.size(); i++)
+        mixed += "line " + std::to_string(i) + ": all quiet\n";
+    mixed += image;
+    const std::byte* data = reinterpret_cast<const std::byte*>(mixed.data());
+    std::vector<std::byte> original(data, data + mixed.size());
+    std::vector<std::size_t> sizes = std::vector<std::size_t>();
+    for (unsigned level : {1u, 4u, 6u, 7u, 9u}) {
+        CscOptions options;
+        options.level = level;
+        std::vector<std::byte> compressed = compressBuffer(data, mixed.size(), options);
+        sizes.push_back(compressed.size());
+        success = success && decompressBuffer(compressed.data(), compressed.size()) == original;
+    }
+    success = success && sizes[2] < sizes[1] && sizes[3] <= sizes[2] && sizes[4] <= sizes[3];
+    return _printPassAndReturn("LevelsTest", success);
+}
+
+bool _TableReuseTest() {
+    // blocks of the same steady text: fast levels build one table and keep it
+    std::string text;
+    for (unsigned i = 0; text.size() < 8 * 16384; i++)
+        text += "entry " + std::to_string(i * 7919 % 1000) + " of the steady log\n";
+    text.resize(8 * 16384);
+    const std::byte* data = reinterpret_cast<const std::byte*>(text.data());
+    bool success = true;
+    for (unsigned level = MIN_LEVEL; level <= MAX_CLAMPED_LEVEL; level++) {
+        std::vector<std::vector<std::byte>> outputs = std::vector<std::vector<std::byte>>();
+        for (std::size_t threads : {1, 4}) {
+            CscStats stats;
+            CscOptions options;
+            options.level = level;
+            options.blockSize = 16384;
+            options.threads = threads;
+            options.stats = &stats;
+            outputs.push_back(compressBuffer(data, text.size(), options));
+            success = success && stats.blocks == 8
+                && (level <= MAX_FAST_LEVEL ? stats.codeTables == 1 : stats.codeTables == 8);
+        }
+        // the tables are picked in block order, so the output doesn't depend on the threads
+        success = success && outputs[0] == outputs[1] && decompressBuffer(outputs[0].data(),
+            outputs[0].size()) == std::vector<std::byte>(data, data + text.size());
+    }
+    return _printPassAndReturn("TableReuseTest", success);
+}
+
+bool _SplitTest() {
+    const std::string image = _referenceImage();
+    std::string text;
+    for (unsigned i = 0; text.size() < 4 * SPLIT_WINDOW_SIZE; i++)
+        text += "line " + std::to_string(i) + ": all quiet\n";
+    text.resize(4 * SPLIT_WINDOW_SIZE);
+    // the shift is found where the JPEG starts, and steady text isn't split
+    std::string mixed = text + image;
+    const std::byte* data = reinterpret_cast<const std::byte*>(mixed.data());
+    std::vector<SplitPart> parts = findSplits(data, mixed.size(), nullptr);
+    bool success = parts.size() == 2 && parts[0].n == text.size()
+        && parts[1].n == image.size()
+        && parts[1].freqs == byteHistogram(data + text.size(), parts[1].n)
+        && findSplits(data, text.size(), nullptr).size() == 1;
+    // a file that shifts is written as blocks, smaller than as one stream
+    std::ofstream("split.txt", std::ios::binary) << mixed;
+    CscOptions options;
+    writeCompFile("split.txt", "split.csc", false, false, options);
+    options.level = MAX_CLAMPED_LEVEL;
+    writeCompFile("split.txt", "unsplit.csc", false, false, options);
+    writeDecompFile("split.csc", "split_restored.txt", false, false);
+    success = success && _sameContents("split.txt", "split_restored.txt")
+        && std::filesystem::file_size("split.csc") < std::filesystem::file_size("unsplit.csc");
+    for (const char* f : {"split.txt", "split.csc", "unsplit.csc", "split_restored.txt"})
+        std::filesystem::remove(f);
+    return _printPassAndReturn("SplitTest", success);
+}
+
+bool _BufferRoundTripTest() {
+    const std::string image = _referenceImage();
+    std::string text = "abracadabra, abracadabra";
+    CscOptions options;
+    options.blockSize = 4096;
+    options.threads = 2;
+    // one encoder and decoder reused across empty, single-stream and blocked payloads
+    Encoder encoder(options);
+    Decoder decoder(options);
+    std::vector<std::byte> compressed = std::vector<std::byte>();
+    std::vector<std::byte> decompressed = std::vector<std::byte>();
+    bool success = true;
+    for (const std::string& payload : {std::string(), text, image, text}) {
+        const std::byte* data = reinterpret_cast<const std::byte*>(payload.data());
+        encoder.compress(data, payload.size(), compressed);
+        decoder.decompress(compressed.data(), compressed.size(), decompressed);
+        success = success && decompressed == std::vector<std::byte>(data, data + payload.size());
+    }
+    return _printPassAndReturn("BufferRoundTripTest", success);
+}
+
+bool _StoredFallbackTest() {
+    const std::string image = _referenceImage();
+    const std::byte* data = reinterpret_cast<const std::byte*>(image.data());
+    // a JPEG is already compressed, so it should cost no more than a header
+    std::vector<std::byte> single = compressBuffer(data, image.size());
+    std::vector<std::byte> header = genStoredHeaderBytes("", image.size(), crc32c(0, data, image.size()));
+    bool success = single.size() == header.size() + image.size()
+        && decompressBuffer(single.data(), single.size())
+            == std::vector<std::byte>(data, data + image.size());
+    // and as blocks, each one stored
+    CscOptions options;
+    options.blockSize = 4096;
+    std::vector<std::byte> blocked = compressBuffer(data, image.size(), options);
+    success = success && blocked.size() < image.size() + 128
+        && decompressBuffer(blocked.data(), blocked.size(), options)
+            == std::vector<std::byte>(data, data + image.size());
+    // a file whose sampled stretches are all one byte: the real coded size has to be checked
+    std::string skewed;
+    for (std::size_t i = 0; i < 8 * MIN_SAMPLED_SIZE; i++)
+        skewed += i % MIN_SAMPLED_SIZE < HISTOGRAM_SAMPLE_STRETCH ? 'a' : image[i % image.size()];
+    std::ofstream("sampled.txt", std::ios::binary) << skewed;
+    CscOptions fast;
+    fast.level = MIN_LEVEL;
+    writeCompFile("sampled.txt", "sampled.csc", false, false, fast);
+    writeDecompFile("sampled.csc", "sampled_restored.txt", false, false);
+    success = success && _sameContents("sampled.txt", "sampled_restored.txt")
+        && std::filesystem::file_size("sampled.csc") <= skewed.size() + header.size() + 4;
+    for (const char* f : {"sampled.txt", "sampled.csc", "sampled_restored.txt"})
+        std::filesystem::remove(f);
+    return _printPassAndReturn("StoredFallbackTest", success);
+}
+
+bool _InterleavedRoundTripTest() {
+    // common digits and letters, with every byte value turning up now and then
+    std::string text;
+    for (unsigned i = 0; text.size() < 40000; i++) {
+        text += std::to_string(i * 7919 % 1000) + " little lambs, ";
+        if (i % 7 == 0)
+            text += (char) (i / 7 % 256);
+    }
+    const std::byte* data = reinterpret_cast<const std::byte*>(text.data());
+    bool success = true;
+    // short codes only (no sub-tables) and long ones; sizes that don't split evenly
+    for (unsigned maxBits : {11, 15}) {
+        CscOptions options;
+        options.interleave = true;
+        options.maxCodeLength = maxBits;
+        options.blockSize = 4099;
+        for (std::size_t n : {text.size(), (std::size_t) 1027, (std::size_t) 7}) {
+            n = std::min(n, text.size());
+            std::vector<std::byte> compressed = compressBuffer(data, n, options);
+            success = success && decompressBuffer(compressed.data(), compressed.size(), options)
+                == std::vector<std::byte>(data, data + n);
+        }
+    }
+    return _printPassAndReturn("InterleavedRoundTripTest", success);
+}
+
+bool _ContextRoundTripTest() {
+    std::string text;
+    for (unsigned i = 0; text.size() < 100000; i++)
+        text += "line " + std::to_string(i * 7919 % 100000) + ": the quick brown fox\n";
+    const std::byte* data = reinterpret_cast<const std::byte*>(text.data());
+    CscOptions plain;
+    plain.blockSize = 32768;
+    CscOptions context = plain;
+    context.contextClusters = DEFAULT_CONTEXT_CLUSTERS;
+    std::vector<std::byte> order0 = compressBuffer(data, text.size(), plain);
+    std::vector<std::byte> order1 = compressBuffer(data, text.size(), context);
+    // the byte before predicts this text's next byte far better than overall counts
+    bool success = order1.size() < order0.size() * 3 / 4
+        && decompressBuffer(order1.data(), order1.size(), context)
+            == std::vector<std::byte>(data, data + text.size());
+    return _printPassAndReturn("ContextRoundTripTest", success);
+}
+
+bool _LzRoundTripTest() {
+    std::string text;
+    for (unsigned i = 0; text.size() < 100000; i++)
+        text += "line " + std::to_string(i * 7919 % 100) + ": the quick brown fox\n";
+    // random bytes repeated: nothing for order-0 coding, everything for matches
+    std::uint32_t seed = 12345;
+    std::string noise;
+    for (unsigned i = 0; i < 8192; i++) {
+        seed = seed * 1103515245 + 12345;
+        noise += (char) (seed >> 24);
+    }
+    text += noise + noise + noise + noise;
+    const std::byte* data = reinterpret_cast<const std::byte*>(text.data());
+    CscOptions plain;
+    plain.blockSize = 65536;
+    CscOptions lz = plain;
+    lz.lzLevel = DEFAULT_LZ_LEVEL;
+    std::vector<std::byte> order0 = compressBuffer(data, text.size(), plain);
+    std::vector<std::byte> matched = compressBuffer(data, text.size(), lz);
+    bool success = matched.size() < order0.size() / 4
+        && decompressBuffer(matched.data(), matched.size(), lz)
+            == std::vector<std::byte>(data, data + text.size());
+    return _printPassAndReturn("LzRoundTripTest", success);
+}
+
+bool _StatsTest() {
+    std::string text;
+    for (unsigned i = 0; text.size() < 4 * 16384; i++)
+        text += "entry " + std::to_string(i % 97) + "\n";
+    text.resize(4 * 16384);
+    const std::byte* data = reinterpret_cast<const std::byte*>(text.data());
+    CscStats stats;
+    CscOptions options;
+    options.blockSize = 16384;
+    options.stats = &stats;
+    std::vector<std::byte> compressed = compressBuffer(data, text.size(), options);
+    bool success = stats.blocks == 4 && stats.bytesIn == text.size()
+        && stats.maxSymbols > 0 && stats.maxCodeLength <= options.maxCodeLength
+        && statsJson(stats).find("\"blocks\":4,") != std::string::npos;
+    return _printPassAndReturn("StatsTest", success);
+}
+
+bool _ChecksumTest() {
+    const char* check = "123456789";
+    bool success = crc32c(0, reinterpret_cast<const std::byte*>(check), 9) == 0xE3069283;
+    std::string text;
+    for (unsigned i = 0; text.size() < 50000; i++)
+        text += "line " + std::to_string(i * 31 % 1009) + " of the log\n";
+    const std::byte* data = reinterpret_cast<const std::byte*>(text.data());
+    // split at odd places, it's the same CRC
+    success = success && crc32c(crc32c(0, data, 12345), data + 12345, text.size() - 12345)
+        == crc32c(0, data, text.size());
+    // the three-stream hardware path, where there is one, matches the table on any alignment and length
+    std::vector<std::byte> noise(200000);
+    std::uint32_t state = 1;
+    for (std::byte& b : noise) {
+        state = state * 1103515245 + 12345;
+        b = (std::byte) (state >> 23);
+    }
+    for (std::size_t offset : {1, 3, 6}) {
+        for (std::size_t len : {771, 49153, 73731, 199991})
+            success = success && crc32c(0x1234567, noise.data() + offset, len)
+                == crc32cSoftware(0x1234567, noise.data() + offset, len);
+    }
+    // one byte changed in the payload of a single-stream file and of a blocked one
+    for (std::size_t blockSize : {(std::size_t) 0, (std::size_t) 8192}) {
+        CscOptions options;
+        options.blockSize = blockSize;
+        std::vector<std::byte> compressed = compressBuffer(data, text.size(), options);
+        success = success && decompressBuffer(compressed.data(), compressed.size(), options)
+            == std::vector<std::byte>(data, data + text.size());
+        compressed[compressed.size() / 2] ^= (std::byte) 0x10;
+        try {
+            decompressBuffer(compressed.data(), compressed.size(), options);
+            success = false;
+        } catch (const std::runtime_error&) {
+        }
+    }
+    return _printPassAndReturn("ChecksumTest", success);
+}
+
+// A stream file of one block frame whose header claims rawSize bytes
+static std::string _forgedBlockFile(
+        const std::uint8_t type, const std::uint64_t rawSize, const std::vector<std::byte>& body) {
+    std::vector<std::byte> file = genBlockedHeaderBytes("", 0, CSC_FLAG_STREAM);
+    file.push_back((std::byte) type);
+    putVarint(file, rawSize);
+    putVarint(file, body.size());
+    file.insert(file.end(), body.begin(), body.end());
+    file.push_back((std::byte) BLOCK_END);
+    return std::string(reinterpret_cast<const char*>(file.data()), file.size());
+}
+
+bool _MalformedBlockTest() {
+    // a stored block far larger than its body, and a two-symbol code too short for its RAW_SIZE
+    std::vector<std::byte> twoSymbols(256 + 1, (std::byte) 0);
+    twoSymbols[0] = twoSymbols[1] = (std::byte) 1;
+    const std::string forged[] = {
+        _forgedBlockFile(BLOCK_STORED, std::uint64_t(1) << 41, std::vector<std::byte>(4)),
+        _forgedBlockFile(BLOCK_HUFFMAN, 1 << 20, twoSymbols),
+        _forgedBlockFile(BLOCK_LZ, MAX_BLOCK_SIZE + 1, std::vector<std::byte>(64)),
+    };
+    bool success = true;
+    for (const std::string& file : forged) {
+        try {
+            std::istringstream in(file);
+            std::stringstream out;
+            decompressStream(in, out, CscOptions());
+            success = false;
+        } catch (const std::runtime_error&) {
+        }
+        try {
+            decompressBuffer(reinterpret_cast<const std::byte*>(file.data()), file.size());
+            success = false;
+        } catch (const std::runtime_error&) {
+        }
+    }
+    // a stream file of stored blocks whose index claims a huge first block, and one whose
+    // index and frame agree on a size its body can't hold
+    std::string noise(4 * 4096, '\0');
+    std::uint32_t state = 1;
+    for (char& c : noise) {
+        state = state * 1103515245 + 12345;
+        c = (char) (state >> 23);
+    }
+    CscOptions options;
+    options.blockSize = 4096;
+    std::istringstream in(noise);
+    std::stringstream compressed;
+    compressStream(in, compressed, ".bin", options);
+    const std::string valid = compressed.str();
+    std::uint64_t indexOffset = 0;
+    for (std::size_t i = 0; i < 8; i++)
+        indexOffset |= (std::uint64_t) (std::uint8_t) valid[valid.size() - 8 + i] << (i * 8);
+    // the first RAW_SIZE of the index follows NUM_BLOCKS and FRAME_SIZE, each a byte or two
+    std::size_t at = indexOffset;
+    for (unsigned field = 0; field < 2; field++)
+        while ((std::uint8_t) valid[at++] & 0x80) {}
+    std::vector<std::byte> huge = std::vector<std::byte>();
+    putVarint(huge, std::uint64_t(1) << 41);
+    std::string indexForged = valid;
+    indexForged.replace(at, 2, reinterpret_cast<const char*>(huge.data()), huge.size());
+    // RAW_SIZE 4096 becomes 4097 in both places
+    std::string bothForged = valid;
+    const std::size_t frame = bothForged.find(std::string({(char) BLOCK_STORED, '\x80', '\x20', '\x80', '\x20'}));
+    if (frame == std::string::npos)
+        return _printPassAndReturn("MalformedBlockTest", false);
+    bothForged[frame + 1] = bothForged[at] = (char) 0x81;
+    for (const std::string& file : {indexForged, bothForged}) {
+        std::ofstream("forged.csc", std::ios::binary) << file;
+        std::filesystem::remove("forged.bin");
+        try {
+            writeDecompFile("forged.csc", "forged.bin", false, false);
+            success = false;
+        } catch (const std::runtime_error&) {
+        }
+    }
+    for (const char* f : {"forged.csc", "forged.bin"})
+        std::filesystem::remove(f);
+    return _printPassAndReturn("MalformedBlockTest", success);
+}
+
+// A small JSON object like the i-th of many records
+static std::string _jsonRecord(const unsigned i) {
+    return "{\"id\": " + std::to_string(i * 7919 % 100000) + ", \"name\": \"user"
+        + std::to_string(i % 613) + "\", \"active\": " + (i % 3 ? "true" : "false")
+        + ", \"tags\": [\"a\", \"b" + std::to_string(i % 17) + "\"]}\n";
+}
+
+bool _DictionaryTest() {
+    std::vector<std::vector<std::uint64_t>> samples = std::vector<std::vector<std::uint64_t>>();
+    for (unsigned i = 0; i < 300; i++) {
+        std::string sample = _jsonRecord(i);
+        samples.push_back(byteHistogram(reinterpret_cast<const std::byte*>(sample.data()), sample.size()));
+    }
+    CscDictionary dictionary = trainDictionary(samples, 4, DEFAULT_MAX_CODE_LENGTH);
+    std::vector<std::byte> saved = dictionaryBytes(dictionary);
+    bool success = parseDictionary(saved.data(), saved.size()).id == dictionary.id;
+    std::string text = _jsonRecord(1000) + _jsonRecord(1001);
+    const std::byte* data = reinterpret_cast<const std::byte*>(text.data());
+    const std::vector<std::byte> original(data, data + text.size());
+    CscOptions options;
+    options.dictionary = &dictionary;
+    std::vector<std::byte> plain = compressBuffer(data, text.size());
+    std::vector<std::byte> compressed = compressBuffer(data, text.size(), options);
+    success = success && compressed.size() < plain.size()
+        && decompressBuffer(compressed.data(), compressed.size(), options) == original;
+    // the named table, without counting
+    options.dictionaryTable = (unsigned) dictionary.lengths.size() - 1;
+    compressed = compressBuffer(data, text.size(), options);
+    success = success && decompressBuffer(compressed.data(), compressed.size(), options) == original;
+    // decompressing needs the same dictionary
+    CscDictionary other = trainDictionary(std::vector<std::vector<std::uint64_t>>(1, samples[0]), 1, 11);
+    for (const CscDictionary* wrong : {(const CscDictionary*) nullptr, (const CscDictionary*) &other}) {
+        CscOptions wrongOptions;
+        wrongOptions.dictionary = wrong;
+        try {
+            decompressBuffer(compressed.data(), compressed.size(), wrongOptions);
+            success = false;
+        } catch (const std::invalid_argument&) {
+        }
+    }
+    return _printPassAndReturn("DictionaryTest", success);
+}
+
+bool _HuffTreeTest() {
+    // the textbook example: a:45 b:13 c:12 d:16 e:9 f:5
+    std::vector<std::uint64_t> freqs = {45, 13, 12, 16, 9, 5};
+    std::vector<std::uint8_t> expected = {1, 3, 3, 3, 4, 4};
+    HuffTree tree;
+    std::vector<std::uint8_t> lengths(freqs.size(), 0);
+    tree.build(freqs.data(), freqs.size());
+    tree.codeLengths(lengths.data());
+    bool success = lengths == expected && tree.size() == 11;
+    // the same object rebuilt for a single symbol
+    std::vector<std::uint64_t> single = {0, 7, 0};
+    std::vector<std::uint8_t> singleLengths(single.size(), 0);
+    tree.build(single.data(), single.size());
+    tree.codeLengths(singleLengths.data());
+    success = success && singleLengths == std::vector<std::uint8_t>({0, 1, 0});
+    return _printPassAndReturn("HuffTreeTest", success);
+}
+
 bool _RunTests() {
     auto successTracker = std::vector<bool>();
+    successTracker.push_back(_HuffTreeTest());
     successTracker.push_back(_AllWriteTest());
+    successTracker.push_back(_V1DecodeTest());
+    successTracker.push_back(_BlockRoundTripTest());
+    successTracker.push_back(_RangeDecodeTest());
+    successTracker.push_back(_ArchiveRoundTripTest());
+    successTracker.push_back(_StreamRoundTripTest());
+    successTracker.push_back(_IncrementalTest());
+    successTracker.push_back(_PipelineTest());
+    successTracker.push_back(_LevelsTest());
+    successTracker.push_back(_TableReuseTest());
+    successTracker.push_back(_SplitTest());
+    successTracker.push_back(_BufferRoundTripTest());
+    successTracker.push_back(_StoredFallbackTest());
+    successTracker.push_back(_InterleavedRoundTripTest());
+    successTracker.push_back(_ContextRoundTripTest());
+    successTracker.push_back(_LzRoundTripTest());
+    successTracker.push_back(_StatsTest());
+    successTracker.push_back(_ChecksumTest());
+    successTracker.push_back(_MalformedBlockTest());
+    successTracker.push_back(_DictionaryTest());
     for (auto x : successTracker)
         if (x == false) return false;
     return _printPassAndReturn("All tests", true);
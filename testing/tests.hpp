@@ -1,4 +1,40 @@
 #include <map>
 #include <huffer.hpp>
+#include <archive.hpp>
+#include <blocks.hpp>
+#include <codec.hpp>
+#include <context.hpp>
+#include <lz.hpp>
+#include <stats.hpp>
+#include <checksum.hpp>
+#include <dictionary.hpp>
+#include <histogram.hpp>
+#include <pipeline.hpp>
+#include <split.hpp>
+#include <sstream>
+#include <algorithm>
+bool _HuffTreeTest();
 bool _AllWriteTest();
+bool _sameContents(const std::string file1, const std::string file2);
+// The test directory's reference.jpg, read whole
+std::string _referenceImage();
+bool _V1DecodeTest();
+bool _BlockRoundTripTest();
+bool _RangeDecodeTest();
+bool _ArchiveRoundTripTest();
+bool _StreamRoundTripTest();
+bool _IncrementalTest();
+bool _PipelineTest();
+bool _LevelsTest();
+bool _TableReuseTest();
+bool _SplitTest();
+bool _BufferRoundTripTest();
+bool _StoredFallbackTest();
+bool _InterleavedRoundTripTest();
+bool _ContextRoundTripTest();
+bool _LzRoundTripTest();
+bool _StatsTest();
+bool _ChecksumTest();
+bool _MalformedBlockTest();
+bool _DictionaryTest();
 bool _RunTests();